@@ -12,36 +12,66 @@ else:
 cflags = shlex.split(os.getenv("CFLAGS", ""))
 ldflags = shlex.split(os.getenv("LDFLAGS", ""))
 
+OOZ_SOURCES = [
+    "ooz/bitknit.cpp",
+    "ooz/compr_entropy.cpp",
+    "ooz/compr_kraken.cpp",
+    "ooz/compr_leviathan.cpp",
+    "ooz/compr_match_finder.cpp",
+    "ooz/compr_mermaid.cpp",
+    "ooz/compr_multiarray.cpp",
+    "ooz/compr_tans.cpp",
+    "ooz/compress.cpp",
+    "ooz/kraken.cpp",
+    "ooz/lzna.cpp",
+    "ooz/stdafx.cpp",
+]
+
 setup(
     ext_modules=[
+        Extension(
+            name="zamboni.blowfish",
+            sources=["src/blowfish.cpp", "src/blowfish_cipher.cpp", "src/stats.cpp"],
+            extra_compile_args=[*EXTRA_COMPILE_ARGS, *cflags],
+            extra_link_args=ldflags,
+        ),
         Extension(
             name="zamboni.crc",
-            sources=["src/crc.cpp"],
+            sources=["src/crc.cpp", "src/crc_checksum.cpp", "src/stats.cpp"],
             extra_compile_args=[*EXTRA_COMPILE_ARGS, *cflags],
             extra_link_args=ldflags,
         ),
         Extension(
             name="zamboni.floatage",
-            sources=["src/floatage.cpp"],
+            sources=["src/floatage.cpp", "src/floatage_decrypt.cpp", "src/stats.cpp"],
+            extra_compile_args=[*EXTRA_COMPILE_ARGS, *cflags],
+            extra_link_args=ldflags,
+        ),
+        Extension(
+            name="zamboni.native",
+            sources=[
+                *OOZ_SOURCES,
+                "src/batch.cpp",
+                "src/blowfish_cipher.cpp",
+                "src/crc_checksum.cpp",
+                "src/floatage_decrypt.cpp",
+                "src/group.cpp",
+                "src/ice.cpp",
+                "src/native.cpp",
+                "src/prs_comp.cpp",
+                "src/prs_decomp.cpp",
+                "src/stats.cpp",
+            ],
+            include_dirs=["ooz"],
             extra_compile_args=[*EXTRA_COMPILE_ARGS, *cflags],
             extra_link_args=ldflags,
         ),
         Extension(
             name="zamboni.ooz",
             sources=[
-                "ooz/bitknit.cpp",
-                "ooz/compr_entropy.cpp",
-                "ooz/compr_kraken.cpp",
-                "ooz/compr_leviathan.cpp",
-                "ooz/compr_match_finder.cpp",
-                "ooz/compr_mermaid.cpp",
-                "ooz/compr_multiarray.cpp",
-                "ooz/compr_tans.cpp",
-                "ooz/compress.cpp",
-                "ooz/kraken.cpp",
-                "ooz/lzna.cpp",
-                "ooz/stdafx.cpp",
+                *OOZ_SOURCES,
                 "src/ooz.cpp",
+                "src/stats.cpp",
             ],
             include_dirs=["ooz"],
             extra_compile_args=[*EXTRA_COMPILE_ARGS, *cflags],
@@ -53,6 +83,7 @@ setup(
                 "src/prs.cpp",
                 "src/prs_comp.cpp",
                 "src/prs_decomp.cpp",
+                "src/stats.cpp",
             ],
             extra_compile_args=[*EXTRA_COMPILE_ARGS, *cflags],
             extra_link_args=ldflags,
@@ -0,0 +1,559 @@
+#include "batch.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "crc.hpp"
+#include "group.hpp"
+#include "ice.hpp"
+#include "thread_pool.hpp"
+
+namespace Zamboni {
+namespace Batch {
+
+namespace {
+
+std::vector<std::byte> ReadFile(const std::filesystem::path& path) {
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    throw std::runtime_error{"Failed to open file"};
+  }
+
+  std::vector<std::byte> data(std::filesystem::file_size(path));
+  const Stats::Timer timer{Stats::Stage::Io, data.size()};
+  if (!file.read(reinterpret_cast<char*>(data.data()), std::ssize(data))) {
+    throw std::runtime_error{"Failed to read file"};
+  }
+
+  return data;
+}
+
+void WriteFile(const std::filesystem::path& path, std::span<const std::byte> data) {
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  if (!file) {
+    throw std::runtime_error{"Failed to write file"};
+  }
+
+  {
+    const Stats::Timer timer{Stats::Stage::Io, data.size()};
+    file.write(reinterpret_cast<const char*>(data.data()), std::ssize(data));
+    file.close();
+  }
+
+  if (!file) {
+    throw std::runtime_error{"Failed to write file"};
+  }
+}
+
+// Read-only memory map of a whole file
+class MappedFile {
+ public:
+  explicit MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+    const auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error{"Failed to open file"};
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+      CloseHandle(file);
+      throw std::runtime_error{"Failed to read file"};
+    }
+    mSize = static_cast<std::size_t>(size.QuadPart);
+
+    // Empty files cannot be mapped
+    if (mSize > 0) {
+      const auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      if (mapping) {
+        mData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(file);
+#else
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::runtime_error{"Failed to open file"};
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      close(fd);
+      throw std::runtime_error{"Failed to read file"};
+    }
+    mSize = static_cast<std::size_t>(info.st_size);
+
+    // Empty files cannot be mapped
+    if (mSize > 0) {
+      mData = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mData == MAP_FAILED) {
+        mData = nullptr;
+      } else {
+        posix_madvise(mData, mSize, POSIX_MADV_SEQUENTIAL);
+      }
+    }
+    close(fd);
+#endif
+
+    if (mSize > 0 && !mData) {
+      throw std::runtime_error{"Failed to map file"};
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (!mData) {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(mData);
+#else
+    munmap(mData, mSize);
+#endif
+  }
+
+  std::span<const std::byte> Data() const { return {static_cast<const std::byte*>(mData), mSize}; }
+
+ private:
+  void* mData = nullptr;
+  std::size_t mSize = 0;
+};
+
+std::string ToHex(std::uint32_t value) {
+  char buffer[10] = {'0', 'x'};
+  const auto end = std::to_chars(buffer + 2, std::end(buffer), value, 16).ptr;
+  return {buffer, end};
+}
+
+// Writes each file of a group as it is decoded
+class FileWriter final : public Group::FileSink {
+ public:
+  FileWriter(std::filesystem::path outDir, const UnpackOptions& options, std::vector<std::filesystem::path>& unpacked)
+      : mOutDir{std::move(outDir)}, mOptions{options}, mUnpacked{unpacked} {}
+
+  void Begin(std::string name, std::size_t /*offset*/) override {
+    if (!mCreatedDir) {
+      std::filesystem::create_directories(mOutDir);
+      mCreatedDir = true;
+    }
+
+    mPath = mOutDir / std::filesystem::path{std::u8string{name.begin(), name.end()}};
+    mName = std::move(name);
+    mSize = 0;
+
+    mFile.open(mPath, std::ios::binary | std::ios::trunc);
+    if (!mFile) {
+      throw std::runtime_error{"Failed to write file"};
+    }
+
+    if (mOptions.dumpRawData) {
+      // The size of the header only depends on the name, so reserve space for it until the data size is known
+      WriteBytes(Group::FileHeader(mName, 0));
+    }
+  }
+
+  void Write(std::span<const std::byte> data) override {
+    WriteBytes(data);
+    mSize += data.size();
+  }
+
+  void End() override {
+    if (mOptions.dumpRawData) {
+      static constexpr std::byte Padding[0x10]{};
+      WriteBytes(std::span{Padding}.first(Group::FilePaddingSize(mSize)));
+
+      mFile.seekp(0);
+      WriteBytes(Group::FileHeader(mName, mSize));
+    }
+
+    mFile.close();
+    if (!mFile) {
+      throw std::runtime_error{"Failed to write file"};
+    }
+
+    mUnpacked.push_back(mPath);
+  }
+
+ private:
+  void WriteBytes(std::span<const std::byte> data) {
+    const Stats::Timer timer{Stats::Stage::Io, data.size()};
+    mFile.write(reinterpret_cast<const char*>(data.data()), std::ssize(data));
+  }
+
+  std::filesystem::path mOutDir;
+  const UnpackOptions& mOptions;
+  std::vector<std::filesystem::path>& mUnpacked;
+  bool mCreatedDir = false;
+
+  std::filesystem::path mPath;
+  std::string mName;
+  std::size_t mSize = 0;
+  std::ofstream mFile;
+};
+
+// An extracted file waiting for an I/O thread to write it
+struct PendingFile {
+  std::size_t job;
+  std::filesystem::path path;
+  std::vector<std::byte> data;
+};
+
+// Gathers each file of a group in memory, then queues it to be written
+class QueuedFileWriter final : public Group::FileSink {
+ public:
+  QueuedFileWriter(std::size_t job, std::filesystem::path outDir, const UnpackOptions& options,
+                   std::vector<std::filesystem::path>& unpacked, BoundedQueue<PendingFile>& queue)
+      : mJob{job}, mOutDir{std::move(outDir)}, mOptions{options}, mUnpacked{unpacked}, mQueue{queue} {}
+
+  void Begin(std::string name, std::size_t /*offset*/) override {
+    if (!mCreatedDir) {
+      std::filesystem::create_directories(mOutDir);
+      mCreatedDir = true;
+    }
+
+    mPath = mOutDir / std::filesystem::path{std::u8string{name.begin(), name.end()}};
+    mName = std::move(name);
+    mData.clear();
+
+    if (mOptions.dumpRawData) {
+      // The size of the header only depends on the name, so reserve space for it until the data size is known
+      mData.resize(Group::FileHeaderSize(mName));
+    }
+  }
+
+  void Write(std::span<const std::byte> data) override { mData.insert(mData.end(), data.begin(), data.end()); }
+
+  void End() override {
+    if (mOptions.dumpRawData) {
+      const auto headerSize = Group::FileHeaderSize(mName);
+      const auto size = mData.size() - headerSize;
+      mData.resize(mData.size() + Group::FilePaddingSize(size));
+
+      const auto header = Group::FileHeader(mName, size);
+      std::ranges::copy(header, mData.begin());
+    }
+
+    mUnpacked.push_back(mPath);
+
+    const auto size = mData.size();
+    mQueue.Push({.job = mJob, .path = mPath, .data = std::move(mData)}, size);
+    mData = {};
+  }
+
+ private:
+  std::size_t mJob;
+  std::filesystem::path mOutDir;
+  const UnpackOptions& mOptions;
+  std::vector<std::filesystem::path>& mUnpacked;
+  BoundedQueue<PendingFile>& mQueue;
+  bool mCreatedDir = false;
+
+  std::filesystem::path mPath;
+  std::string mName;
+  std::vector<std::byte> mData;
+};
+
+// Records each file of a group with its checksum instead of writing it
+class ChecksumSink final : public Group::FileSink {
+ public:
+  ChecksumSink(std::size_t group, std::vector<IndexedFile>& files) : mGroup{group}, mFiles{files} {}
+
+  void Begin(std::string name, std::size_t offset) override {
+    mFiles.push_back({.name = std::move(name), .group = mGroup, .offset = offset, .size = 0, .crc32 = 0});
+  }
+
+  void Write(std::span<const std::byte> data) override {
+    auto& file = mFiles.back();
+    file.size += data.size();
+    file.crc32 = Crc::Update(data, file.crc32);
+  }
+
+  void End() override {}
+
+ private:
+  std::size_t mGroup;
+  std::vector<IndexedFile>& mFiles;
+};
+
+// Unpack archives in three stages that run at the same time: I/O threads read archives in order, the decoding threads
+// extract them, and the I/O threads write the files. The queues between the stages are bounded, so reading stops while
+// the decoders are behind and decoding stops while the writers are behind.
+std::vector<UnpackResult> UnpackPipelined(std::span<const UnpackJob> jobs, const UnpackOptions& options, int threads) {
+  struct LoadedArchive {
+    std::size_t job;
+    std::vector<std::byte> data;
+  };
+
+  std::vector<UnpackResult> results(jobs.size());
+  // Guards the errors and stats of results, which several stages can update for the same archive
+  std::mutex resultsMutex;
+
+  auto fail = [&](std::size_t job, const std::exception& ex) {
+    const std::lock_guard lock{resultsMutex};
+    if (results[job].error.empty()) {
+      results[job].error = ex.what();
+    }
+  };
+
+  auto addStats = [&](std::size_t job, const Stats::Counters& start) {
+    const auto stats = Stats::ThreadSince(start);
+    const std::lock_guard lock{resultsMutex};
+    Stats::Accumulate(results[job].stats, stats);
+  };
+
+  BoundedQueue<LoadedArchive> loaded{options.queueSize};
+  std::atomic<std::size_t> nextJob{0};
+
+  // Each writer has its own queue, and all the files of an archive go to the same one. They are written in order, so a
+  // name that is in both groups ends up with the second group's file, as when unpacking without I/O threads.
+  std::vector<std::unique_ptr<BoundedQueue<PendingFile>>> pending{};
+  for (auto n = 0; n < options.ioThreads; n++) {
+    pending.push_back(std::make_unique<BoundedQueue<PendingFile>>(options.queueSize / options.ioThreads));
+  }
+
+  std::vector<std::jthread> readers{};
+  std::vector<std::jthread> decoders{};
+  std::vector<std::jthread> writers{};
+
+  for (auto n = 0; n < options.ioThreads; n++) {
+    readers.emplace_back([&] {
+      for (auto job = nextJob++; job < jobs.size(); job = nextJob++) {
+        const auto start = Stats::ThreadSnapshot();
+        try {
+          auto data = ReadFile(jobs[job].input);
+          addStats(job, start);
+
+          const auto size = data.size();
+          loaded.Push({.job = job, .data = std::move(data)}, size);
+        } catch (const std::exception& ex) {
+          fail(job, ex);
+        }
+      }
+    });
+  }
+
+  for (auto n = 0; n < (threads > 0 ? threads : DefaultThreadCount()); n++) {
+    decoders.emplace_back([&] {
+      while (auto archive = loaded.Pop()) {
+        const auto job = archive->job;
+        auto& queue = *pending[job % pending.size()];
+        const auto start = Stats::ThreadSnapshot();
+
+        try {
+          const auto ice = Ice::Parse(archive->data);
+
+          for (std::size_t i = 0; i < ice.groups.size(); i++) {
+            const auto& group = ice.groups[i];
+            auto outDir = options.useGroups ? jobs[job].outDir / ("group" + std::to_string(i + 1)) : jobs[job].outDir;
+
+            // Only this thread adds to the archive's files
+            QueuedFileWriter writer{job, std::move(outDir), options, results[job].files, queue};
+            Group::ExtractFiles(group.data, group.header, ice.ExtractOptions(i), writer);
+          }
+        } catch (const std::exception& ex) {
+          fail(job, ex);
+        }
+
+        addStats(job, start);
+      }
+    });
+  }
+
+  for (auto n = 0; n < options.ioThreads; n++) {
+    writers.emplace_back([&, n] {
+      while (auto file = pending[n]->Pop()) {
+        const auto start = Stats::ThreadSnapshot();
+        try {
+          WriteFile(file->path, file->data);
+        } catch (const std::exception& ex) {
+          fail(file->job, ex);
+        }
+        addStats(file->job, start);
+      }
+    });
+  }
+
+  // Each stage ends once the one before it has finished and its queue is drained
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  loaded.Close();
+
+  for (auto& decoder : decoders) {
+    decoder.join();
+  }
+  for (auto& queue : pending) {
+    queue->Close();
+  }
+
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  return results;
+}
+
+}  // namespace
+
+std::vector<std::filesystem::path> Unpack(const UnpackJob& job, const UnpackOptions& options) {
+  const auto data = ReadFile(job.input);
+  const auto archive = Ice::Parse(data);
+
+  std::vector<std::filesystem::path> unpacked{};
+
+  for (std::size_t i = 0; i < archive.groups.size(); i++) {
+    const auto& group = archive.groups[i];
+    const auto outDir = options.useGroups ? job.outDir / ("group" + std::to_string(i + 1)) : job.outDir;
+
+    FileWriter writer{outDir, options, unpacked};
+    Group::ExtractFiles(group.data, group.header, archive.ExtractOptions(i), writer);
+  }
+
+  return unpacked;
+}
+
+std::vector<UnpackResult> UnpackMany(std::span<const UnpackJob> jobs, const UnpackOptions& options, int threads) {
+  if (options.ioThreads > 0) {
+    return UnpackPipelined(jobs, options, threads);
+  }
+
+  std::vector<UnpackResult> results(jobs.size());
+
+  {
+    ThreadPool pool{threads};
+
+    for (std::size_t i = 0; i < jobs.size(); i++) {
+      pool.Submit([&, i] {
+        // Each archive is unpacked on one thread, so its stages are what that thread counted meanwhile
+        const auto start = Stats::ThreadSnapshot();
+        try {
+          results[i].files = Unpack(jobs[i], options);
+        } catch (const std::exception& ex) {
+          results[i].error = ex.what();
+        }
+        results[i].stats = Stats::ThreadSince(start);
+      });
+    }
+  }
+
+  return results;
+}
+
+VerifyResult Verify(const std::filesystem::path& path) {
+  // Each worker keeps its buffers, so they are only allocated for the largest group it has seen
+  thread_local Group::VerifyBuffers buffers;
+
+  VerifyResult result{};
+
+  try {
+    const MappedFile file{path};
+    const auto archive = Ice::Parse(file.Data());
+
+    for (std::size_t i = 0; i < archive.groups.size(); i++) {
+      const auto& group = archive.groups[i];
+      const auto name = "Group " + std::to_string(i + 1);
+
+      try {
+        const auto checksum = Group::Verify(group.data, group.header, archive.ExtractOptions(i), buffers);
+        if (checksum != group.header.crc32) {
+          result.errors.push_back(name + " checksum is " + ToHex(checksum) + " but header says " +
+                                  ToHex(group.header.crc32));
+        }
+      } catch (const std::exception& ex) {
+        result.errors.push_back(name + ": " + ex.what());
+      }
+    }
+  } catch (const std::exception& ex) {
+    result.errors.push_back(ex.what());
+  }
+
+  return result;
+}
+
+std::vector<VerifyResult> VerifyMany(std::span<const std::filesystem::path> paths, int threads) {
+  std::vector<VerifyResult> results(paths.size());
+
+  {
+    ThreadPool pool{threads};
+
+    for (std::size_t i = 0; i < paths.size(); i++) {
+      pool.Submit([&, i] {
+        const auto start = Stats::ThreadSnapshot();
+        results[i] = Verify(paths[i]);
+        results[i].stats = Stats::ThreadSince(start);
+      });
+    }
+  }
+
+  return results;
+}
+
+IndexResult Index(const std::filesystem::path& path) {
+  IndexResult result{};
+
+  try {
+    const MappedFile file{path};
+    const auto archive = Ice::Parse(file.Data());
+    result.version = archive.version;
+    result.flags = archive.meta.flags;
+
+    for (std::size_t i = 0; i < archive.groups.size(); i++) {
+      const auto& group = archive.groups[i];
+
+      ChecksumSink sink{i, result.files};
+      Group::ExtractFiles(group.data, group.header, archive.ExtractOptions(i), sink);
+    }
+  } catch (const std::exception& ex) {
+    result.files.clear();
+    result.error = ex.what();
+  }
+
+  return result;
+}
+
+std::vector<IndexResult> IndexMany(std::span<const std::filesystem::path> paths, int threads) {
+  std::vector<IndexResult> results(paths.size());
+
+  {
+    ThreadPool pool{threads};
+
+    for (std::size_t i = 0; i < paths.size(); i++) {
+      pool.Submit([&, i] { results[i] = Index(paths[i]); });
+    }
+  }
+
+  return results;
+}
+
+}  // namespace Batch
+}  // namespace Zamboni
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "stats.hpp"
+
+namespace Zamboni {
+namespace Batch {
+
+struct UnpackOptions {
+  // Write the files of each group to "group1" and "group2" subdirectories
+  bool useGroups = false;
+  // Keep the data file headers
+  bool dumpRawData = false;
+  // Threads that read archives ahead of the decoding threads and write their files behind them, so that the disk and
+  // the CPUs are kept busy at the same time. 0 reads and writes on the decoding threads.
+  int ioThreads = 0;
+  // Most bytes of archives that are read ahead, and separately of files waiting to be written, with I/O threads
+  std::size_t queueSize = std::size_t{256} << 20;
+};
+
+struct UnpackJob {
+  std::filesystem::path input;
+  std::filesystem::path outDir;
+};
+
+struct UnpackResult {
+  std::vector<std::filesystem::path> files;
+  // Empty if the archive was unpacked successfully
+  std::string error;
+  // Stages run for this archive, if counting is enabled
+  Stats::Counters stats{};
+};
+
+// Read, extract and split an archive, then write its files. Returns the paths written.
+std::vector<std::filesystem::path> Unpack(const UnpackJob& job, const UnpackOptions& options);
+
+// Unpack archives on a work-stealing thread pool, using one thread per core if threads is 0. An archive that fails
+// reports the error in its result without stopping the others. With I/O threads, archives are read in order ahead of
+// the decoding threads instead, and files are written as soon as they are decoded.
+std::vector<UnpackResult> UnpackMany(std::span<const UnpackJob> jobs, const UnpackOptions& options, int threads = 0);
+
+struct VerifyResult {
+  // Problems found in the archive, or empty if it is intact
+  std::vector<std::string> errors;
+  // Stages run for this archive, if counting is enabled
+  Stats::Counters stats{};
+};
+
+// Check an archive without extracting its files. The archive is memory-mapped, and each group is checksummed and
+// decompressed into a buffer that is reused between groups.
+VerifyResult Verify(const std::filesystem::path& path);
+
+// Verify archives on a work-stealing thread pool, using one thread per core if threads is 0
+std::vector<VerifyResult> VerifyMany(std::span<const std::filesystem::path> paths, int threads = 0);
+
+struct IndexedFile {
+  // UTF-8 file name
+  std::string name;
+  // Index of the group the file is in
+  std::size_t group = 0;
+  // Location of the file data in the extracted group, not including its header
+  std::size_t offset = 0;
+  std::size_t size = 0;
+  std::uint32_t crc32 = 0;
+};
+
+struct IndexResult {
+  std::uint32_t version = 0;
+  std::uint32_t flags = 0;
+  std::vector<IndexedFile> files;
+  // Empty if the archive was indexed successfully
+  std::string error;
+};
+
+// List the files in an archive along with their checksums, without keeping their data. The archive is memory-mapped
+// and each group is decoded in pieces as Unpack() does.
+IndexResult Index(const std::filesystem::path& path);
+
+// Index archives on a work-stealing thread pool, using one thread per core if threads is 0
+std::vector<IndexResult> IndexMany(std::span<const std::filesystem::path> paths, int threads = 0);
+
+}  // namespace Batch
+}  // namespace Zamboni
\ No newline at end of file
@@ -0,0 +1,481 @@
+#include <ooz.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "blowfish.hpp"
+#include "crc.hpp"
+#include "floatage.hpp"
+#include "group.hpp"
+#include "ice.hpp"
+#include "prs.hpp"
+
+namespace {
+
+using Buffer = std::vector<std::byte>;
+using Clock = std::chrono::steady_clock;
+
+// Benchmark results are stored here so the compiler can't skip computing them
+volatile std::size_t Sink = 0;
+
+constexpr std::array<std::byte, 4> BenchmarkKey{std::byte{0x12}, std::byte{0x34}, std::byte{0x56}, std::byte{0x78}};
+
+struct Archive {
+  std::filesystem::path path;
+  Buffer data;
+  Zamboni::Ice::Archive archive;
+};
+
+struct Corpus {
+  // Files to run the codecs on. This also holds the extracted groups of every archive.
+  std::vector<Buffer> files;
+  std::vector<Archive> archives;
+
+  std::size_t FileBytes() const {
+    std::size_t total = 0;
+    for (const auto& file : files) {
+      total += file.size();
+    }
+    return total;
+  }
+};
+
+struct Result {
+  std::string name;
+  // Uncompressed bytes processed by each iteration
+  std::size_t bytes = 0;
+  std::size_t iterations = 0;
+  double seconds = 0;
+  // Output bytes of each iteration, for benchmarks where the output size is meaningful
+  std::optional<std::size_t> outputBytes;
+};
+
+Buffer ReadFile(const std::filesystem::path& path) {
+  std::ifstream file{path, std::ios::binary};
+  if (!file) {
+    throw std::runtime_error{"Failed to open " + path.string()};
+  }
+
+  Buffer data(std::filesystem::file_size(path));
+  if (!file.read(reinterpret_cast<char*>(data.data()), std::ssize(data))) {
+    throw std::runtime_error{"Failed to read " + path.string()};
+  }
+
+  return data;
+}
+
+bool IsArchive(const Buffer& data) {
+  static constexpr std::array Signature{std::byte{'I'}, std::byte{'C'}, std::byte{'E'}, std::byte{0}};
+  return data.size() >= Signature.size() && std::equal(Signature.begin(), Signature.end(), data.begin());
+}
+
+std::vector<Buffer> ExtractGroups(const Zamboni::Ice::Archive& archive) {
+  std::vector<Buffer> groups;
+  for (std::size_t i = 0; i < archive.groups.size(); i++) {
+    if (archive.groups[i].header.originalSize) {
+      groups.push_back(archive.ExtractGroup(i));
+    }
+  }
+  return groups;
+}
+
+void AddFile(Corpus& corpus, const std::filesystem::path& path) {
+  auto data = ReadFile(path);
+
+  if (IsArchive(data)) {
+    try {
+      auto archive = Zamboni::Ice::Parse(data);
+      for (auto& group : ExtractGroups(archive)) {
+        corpus.files.push_back(std::move(group));
+      }
+      corpus.archives.push_back({.path = path, .data = std::move(data), .archive = archive});
+      return;
+    } catch (const std::exception& ex) {
+      std::cerr << "Skipping " << path.string() << ": " << ex.what() << "\n";
+      return;
+    }
+  }
+
+  if (!data.empty()) {
+    corpus.files.push_back(std::move(data));
+  }
+}
+
+Corpus LoadCorpus(const std::vector<std::string>& paths) {
+  Corpus corpus;
+
+  for (const auto& path : paths) {
+    if (std::filesystem::is_directory(path)) {
+      std::vector<std::filesystem::path> files;
+      for (const auto& entry : std::filesystem::recursive_directory_iterator{path}) {
+        if (entry.is_regular_file()) {
+          files.push_back(entry.path());
+        }
+      }
+
+      std::ranges::sort(files);
+      for (const auto& file : files) {
+        AddFile(corpus, file);
+      }
+    } else if (std::filesystem::is_regular_file(path)) {
+      AddFile(corpus, path);
+    } else {
+      throw std::invalid_argument{path + " is not a file or directory"};
+    }
+  }
+
+  return corpus;
+}
+
+class Runner {
+ public:
+  Runner(double minTime, std::optional<std::regex> filter) : mMinTime{minTime}, mFilter{std::move(filter)} {}
+
+  bool Enabled(const std::string& name) const { return !mFilter || std::regex_search(name, *mFilter); }
+
+  // Call func until at least the minimum time has passed. func processes `bytes` bytes of input and returns the size
+  // of its output, or any other value that depends on the work it did.
+  template <class Func>
+  void Run(const std::string& name, std::size_t bytes, Func&& func, bool recordOutput = false) {
+    if (!Enabled(name) || bytes == 0) {
+      return;
+    }
+
+    Result result{.name = name, .bytes = bytes, .iterations = 0, .seconds = 0, .outputBytes = std::nullopt};
+    const auto start = Clock::now();
+    std::chrono::duration<double> elapsed{};
+
+    do {
+      const std::size_t output = func();
+      Sink = output;
+      result.iterations++;
+      elapsed = Clock::now() - start;
+
+      if (recordOutput) {
+        result.outputBytes = output;
+      }
+    } while (elapsed.count() < mMinTime);
+
+    result.seconds = elapsed.count();
+    std::cerr << name << ": " << std::fixed << std::setprecision(1) << Throughput(result) << " MB/s\n";
+    mResults.push_back(std::move(result));
+  }
+
+  const std::vector<Result>& Results() const { return mResults; }
+
+  static double Throughput(const Result& result) {
+    return static_cast<double>(result.bytes) * static_cast<double>(result.iterations) / result.seconds / 1e6;
+  }
+
+ private:
+  double mMinTime;
+  std::optional<std::regex> mFilter;
+  std::vector<Result> mResults;
+};
+
+Buffer KrakenCompress(std::span<const std::byte> input, int level) {
+  Buffer output(input.size() + 0x10000);
+
+  // Kraken_Compress() does not modify its input, despite the signature
+  const auto size = Kraken_Compress(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(input.data())), input.size(),
+                                    reinterpret_cast<uint8_t*>(output.data()), level);
+  if (size < 0) {
+    throw std::runtime_error{"Kraken compression failed"};
+  }
+
+  output.resize(size);
+  return output;
+}
+
+std::size_t KrakenDecompress(std::span<const std::byte> input, Buffer& output, std::size_t outSize) {
+  output.resize(outSize + SAFE_SPACE);
+  const auto size = Kraken_Decompress(reinterpret_cast<const uint8_t*>(input.data()), input.size(),
+                                      reinterpret_cast<uint8_t*>(output.data()), outSize);
+  if (size != static_cast<int>(outSize)) {
+    throw std::runtime_error{"Kraken decompression failed"};
+  }
+  return outSize;
+}
+
+void RunChecksums(Runner& runner, const Corpus& corpus) {
+  runner.Run("crc32", corpus.FileBytes(), [&] {
+    std::uint32_t checksum = 0;
+    for (const auto& file : corpus.files) {
+      checksum ^= Zamboni::Crc::Update(file);
+    }
+    return static_cast<std::size_t>(checksum);
+  });
+}
+
+void RunCiphers(Runner& runner, const Corpus& corpus) {
+  auto scratch = corpus.files;
+  const Zamboni::Blowfish::Cipher cipher{BenchmarkKey};
+
+  runner.Run("floatage/decrypt", corpus.FileBytes(), [&] {
+    for (std::size_t i = 0; i < scratch.size(); i++) {
+      Zamboni::Floatage::Decrypt(corpus.files[i], scratch[i], 0x12345678);
+    }
+    return std::size_t{0};
+  });
+
+  runner.Run("blowfish/encrypt", corpus.FileBytes(), [&] {
+    for (auto& file : scratch) {
+      cipher.Encrypt(file);
+    }
+    return std::size_t{0};
+  });
+
+  runner.Run("blowfish/decrypt", corpus.FileBytes(), [&] {
+    for (auto& file : scratch) {
+      cipher.Decrypt(file);
+    }
+    return std::size_t{0};
+  });
+}
+
+template <class Compress, class Decompress>
+void RunCodec(Runner& runner, const Corpus& corpus, const std::string& name, Compress&& compress,
+              Decompress&& decompress) {
+  const auto compressName = name + "/compress";
+  const auto decompressName = name + "/decompress";
+  if (!runner.Enabled(compressName) && !runner.Enabled(decompressName)) {
+    return;
+  }
+
+  std::vector<Buffer> compressed(corpus.files.size());
+  for (std::size_t i = 0; i < corpus.files.size(); i++) {
+    compressed[i] = compress(corpus.files[i]);
+  }
+
+  runner.Run(
+      compressName, corpus.FileBytes(),
+      [&] {
+        std::size_t total = 0;
+        for (const auto& file : corpus.files) {
+          total += compress(file).size();
+        }
+        return total;
+      },
+      true);
+
+  Buffer output;
+  runner.Run(decompressName, corpus.FileBytes(), [&] {
+    std::size_t total = 0;
+    for (std::size_t i = 0; i < compressed.size(); i++) {
+      total += decompress(compressed[i], output, corpus.files[i].size());
+    }
+    return total;
+  });
+}
+
+void RunCodecs(Runner& runner, const Corpus& corpus, const std::vector<int>& levels) {
+  for (const auto level : levels) {
+    const auto options = Zamboni::Prs::CompressOptions::FromLevel(level);
+
+    RunCodec(
+        runner, corpus, "prs/" + std::to_string(level),
+        [&](std::span<const std::byte> input) { return Zamboni::Prs::Compress(input, options); },
+        [](std::span<const std::byte> input, Buffer& output, std::size_t outSize) {
+          output.resize(outSize);
+          return static_cast<std::size_t>(Zamboni::Prs::Decompress(input, output));
+        });
+  }
+
+  for (const auto level : levels) {
+    RunCodec(
+        runner, corpus, "kraken/" + std::to_string(level),
+        [level](std::span<const std::byte> input) { return KrakenCompress(input, level); }, KrakenDecompress);
+  }
+}
+
+// Read an archive the way unpacking does: parse the headers, then extract and split each group
+std::size_t ReadArchive(const Archive& archive, Buffer& scratch) {
+  const auto parsed = Zamboni::Ice::Parse(archive.data);
+  std::size_t fileCount = 0;
+
+  for (std::size_t i = 0; i < parsed.groups.size(); i++) {
+    const auto& group = parsed.groups[i];
+    const auto options = parsed.ExtractOptions(i);
+
+    scratch.resize(Zamboni::Group::ExtractBufferSize(group.header, options));
+    const auto size = Zamboni::Group::Extract(group.data, group.header, options, scratch);
+    fileCount += Zamboni::Group::Split(group.header, std::span{scratch}.first(size)).size();
+  }
+
+  return fileCount;
+}
+
+// Build and compress the groups of an archive the way packing does, from files that were split out of it
+std::size_t WriteArchive(const Archive& archive, const std::array<Buffer, 2>& groups,
+                         const std::array<std::vector<Zamboni::Group::FileEntry>, 2>& entries) {
+  Zamboni::Group::CompressOptions options;
+  options.compression = archive.archive.meta.KrakenCompressed() ? Zamboni::Group::Compression::Kraken
+                                                                : Zamboni::Group::Compression::Prs;
+
+  std::array<Buffer, 2> combined;
+  std::array<std::span<const std::byte>, 2> inputs;
+  for (std::size_t i = 0; i < groups.size(); i++) {
+    std::vector<Zamboni::Group::FileData> files;
+    for (const auto& entry : entries[i]) {
+      files.push_back({.name = entry.name, .data = std::span{groups[i]}.subspan(entry.offset, entry.size)});
+    }
+
+    combined[i].resize(Zamboni::Group::CombinedSize(files));
+    Zamboni::Group::Combine(files, combined[i]);
+    inputs[i] = combined[i];
+  }
+
+  std::size_t total = 0;
+  for (const auto& output : Zamboni::Group::Compress(inputs, options)) {
+    total += output.size();
+    Sink = Zamboni::Crc::Update(output);
+  }
+  return total;
+}
+
+void RunArchives(Runner& runner, const Corpus& corpus) {
+  for (const auto version : {3u, 4u}) {
+    std::vector<const Archive*> archives;
+    std::size_t originalBytes = 0;
+    for (const auto& archive : corpus.archives) {
+      if (archive.archive.version == version) {
+        archives.push_back(&archive);
+        for (const auto& group : archive.archive.groups) {
+          originalBytes += group.header.originalSize;
+        }
+      }
+    }
+
+    const auto suffix = "/v" + std::to_string(version);
+    Buffer scratch;
+    runner.Run("ice/read" + suffix, originalBytes, [&] {
+      std::size_t total = 0;
+      for (const auto* archive : archives) {
+        total += ReadArchive(*archive, scratch);
+      }
+      return total;
+    });
+
+    if (!runner.Enabled("ice/write" + suffix)) {
+      continue;
+    }
+
+    std::vector<std::array<Buffer, 2>> groups;
+    std::vector<std::array<std::vector<Zamboni::Group::FileEntry>, 2>> entries;
+    for (const auto* archive : archives) {
+      auto& archiveGroups = groups.emplace_back();
+      auto& archiveEntries = entries.emplace_back();
+      for (std::size_t i = 0; i < archiveGroups.size(); i++) {
+        archiveGroups[i] = archive->archive.ExtractGroup(i);
+        archiveEntries[i] = Zamboni::Group::Split(archive->archive.groups[i].header, archiveGroups[i]);
+      }
+    }
+
+    runner.Run(
+        "ice/write" + suffix, originalBytes,
+        [&] {
+          std::size_t total = 0;
+          for (std::size_t i = 0; i < archives.size(); i++) {
+            total += WriteArchive(*archives[i], groups[i], entries[i]);
+          }
+          return total;
+        },
+        true);
+  }
+}
+
+void WriteJson(std::ostream& out, const Corpus& corpus, const std::vector<Result>& results) {
+  out << "{\n"
+      << "  \"corpus\": {\"files\": " << corpus.files.size() << ", \"bytes\": " << corpus.FileBytes()
+      << ", \"archives\": " << corpus.archives.size() << "},\n"
+      << "  \"benchmarks\": [";
+
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const auto& result = results[i];
+    out << (i ? ",\n" : "\n") << std::setprecision(6) << "    {\"name\": \"" << result.name
+        << "\", \"bytes\": " << result.bytes << ", \"iterations\": " << result.iterations
+        << ", \"seconds\": " << result.seconds << ", \"mb_per_s\": " << Runner::Throughput(result);
+
+    if (result.outputBytes) {
+      out << ", \"output_bytes\": " << *result.outputBytes
+          << ", \"ratio\": " << static_cast<double>(*result.outputBytes) / static_cast<double>(result.bytes);
+    }
+    out << "}";
+  }
+
+  out << "\n  ]\n}\n";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options options{"bench", "Benchmark the codecs, checksums, ciphers and ICE archive reading and writing"};
+
+  auto add = options.add_options();
+  add("paths", "files and directories to use as the corpus. ICE archives are also extracted into the corpus.",
+      cxxopts::value<std::vector<std::string>>());
+  add("o,output", "write JSON results to a file instead of stdout", cxxopts::value<std::string>());
+  add("t,time", "minimum time to run each benchmark, in seconds", cxxopts::value<double>()->default_value("1"));
+  add("l,levels", "compression levels to test",
+      cxxopts::value<std::vector<int>>()->default_value("0,1,2,3,4,5,6,7,8,9"));
+  add("f,filter", "only run benchmarks whose names match this regex", cxxopts::value<std::string>());
+  add("h,help", "print usage");
+
+  options.positional_help("PATH...");
+  options.parse_positional({"paths"});
+
+  try {
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help") || !result.count("paths")) {
+      std::cout << options.help() << "\n";
+      return result.count("help") ? 0 : -1;
+    }
+
+    std::optional<std::regex> filter;
+    if (result.count("filter")) {
+      filter.emplace(result["filter"].as<std::string>());
+    }
+
+    const auto corpus = LoadCorpus(result["paths"].as<std::vector<std::string>>());
+    if (corpus.files.empty()) {
+      std::cerr << "The corpus is empty\n";
+      return -1;
+    }
+
+    Runner runner{result["time"].as<double>(), std::move(filter)};
+    RunChecksums(runner, corpus);
+    RunCiphers(runner, corpus);
+    RunCodecs(runner, corpus, result["levels"].as<std::vector<int>>());
+    RunArchives(runner, corpus);
+
+    if (result.count("output")) {
+      std::ofstream out{result["output"].as<std::string>()};
+      WriteJson(out, corpus, runner.Results());
+    } else {
+      WriteJson(std::cout, corpus, runner.Results());
+    }
+
+  } catch (const cxxopts::exceptions::exception& ex) {
+    std::cout << ex.what() << "\n";
+    return -1;
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << "\n";
+    return -1;
+  }
+
+  return 0;
+}
\ No newline at end of file
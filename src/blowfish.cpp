@@ -0,0 +1,88 @@
+#include "blowfish.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "util.hpp"
+
+namespace {
+
+enum class Mode { Encrypt, Decrypt };
+
+template <Mode mode>
+void Apply(std::span<const std::byte> key, std::span<std::byte> data) {
+  const auto cipher = Zamboni::Blowfish::GetCipher(key);
+
+  if constexpr (mode == Mode::Encrypt) {
+    cipher->Encrypt(data);
+  } else {
+    cipher->Decrypt(data);
+  }
+}
+
+template <Mode mode>
+PyObject* BlowfishCopy(PyObject* self, PyObject* args) {
+  PythonBuffer data;
+  PythonBuffer key;
+
+  if (!PyArg_ParseTuple(args, "y*y*", &data, &key)) {
+    return nullptr;
+  }
+
+  auto result = PythonRef(PyBytes_FromStringAndSize(static_cast<const char*>((*data).buf), (*data).len));
+  if (!result) {
+    return nullptr;
+  }
+
+  try {
+    GilRelease nogil;
+    Apply<mode>(AsSpan(*key), BytesAsSpan(*result));
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  }
+
+  return Py_NewRef(*result);
+}
+
+template <Mode mode>
+PyObject* BlowfishInPlace(PyObject* self, PyObject* args) {
+  PythonBuffer data;
+  PythonBuffer key;
+
+  if (!PyArg_ParseTuple(args, "w*y*", &data, &key)) {
+    return nullptr;
+  }
+
+  try {
+    GilRelease nogil;
+    Apply<mode>(AsSpan(*key), AsSpan(*data));
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyMethodDef Methods[] = {
+    {"encrypt", BlowfishCopy<Mode::Encrypt>, METH_VARARGS, nullptr},
+    {"decrypt", BlowfishCopy<Mode::Decrypt>, METH_VARARGS, nullptr},
+    {"encrypt_inplace", BlowfishInPlace<Mode::Encrypt>, METH_VARARGS, nullptr},
+    {"decrypt_inplace", BlowfishInPlace<Mode::Decrypt>, METH_VARARGS, nullptr},
+    {"_stats", GetStats, METH_NOARGS, nullptr},
+    {"_set_stats_enabled", SetStatsEnabled, METH_VARARGS, nullptr},
+    {"_reset_stats", ResetStats, METH_NOARGS, nullptr},
+    {},  // Sentinel
+};
+
+PyModuleDef Module = {
+    .m_base = PyModuleDef_HEAD_INIT,
+    .m_name = "blowfish",
+    .m_size = -1,
+    .m_methods = Methods,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit_blowfish() { return PyModule_Create(&Module); }
\ No newline at end of file
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+namespace Zamboni {
+namespace Blowfish {
+
+constexpr std::size_t BlockSize = 8;
+
+// Blowfish in ECB mode, except each block is read and written as two little-endian words instead of big-endian.
+// Any bytes after the last whole block are left unchanged.
+class Cipher {
+ public:
+  static constexpr int Rounds = 16;
+
+  explicit Cipher(std::span<const std::byte> key);
+
+  void Encrypt(std::span<std::byte> data) const;
+  void Decrypt(std::span<std::byte> data) const;
+
+ private:
+  std::uint32_t F(std::uint32_t x) const;
+  void EncryptBlock(std::uint32_t& left, std::uint32_t& right) const;
+  void DecryptBlock(std::uint32_t& left, std::uint32_t& right) const;
+
+  std::array<std::uint32_t, Rounds + 2> mP;
+  std::array<std::array<std::uint32_t, 256>, 4> mS;
+};
+
+// Get a cipher for a key, reusing the key schedule if the key was used recently. Safe to call from any thread.
+std::shared_ptr<const Cipher> GetCipher(std::span<const std::byte> key);
+
+}  // namespace Blowfish
+}  // namespace Zamboni
\ No newline at end of file
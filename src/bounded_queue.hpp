@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace Zamboni {
+
+// FIFO queue between threads that holds at most a given number of bytes of items, so a fast producer waits for its
+// consumers instead of using more and more memory. An item is always accepted into an empty queue, so one that is
+// larger than the capacity still gets through on its own.
+template <class T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(std::size_t capacity) : mCapacity{capacity} {}
+
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+  BoundedQueue(BoundedQueue&&) = delete;
+  BoundedQueue& operator=(BoundedQueue&&) = delete;
+
+  // Add an item of the given size, waiting until there is room for it
+  void Push(T item, std::size_t size) {
+    std::unique_lock lock{mMutex};
+    mNotFull.wait(lock, [&] { return mItems.empty() || mBytes + size <= mCapacity; });
+
+    mItems.emplace_back(std::move(item), size);
+    mBytes += size;
+    mNotEmpty.notify_one();
+  }
+
+  // Take the oldest item, waiting until there is one. Returns nothing once the queue is closed and empty.
+  std::optional<T> Pop() {
+    std::unique_lock lock{mMutex};
+    mNotEmpty.wait(lock, [&] { return !mItems.empty() || mClosed; });
+
+    if (mItems.empty()) {
+      return std::nullopt;
+    }
+
+    auto [item, size] = std::move(mItems.front());
+    mItems.pop_front();
+    mBytes -= size;
+    mNotFull.notify_all();
+    return std::move(item);
+  }
+
+  // No more items will be pushed, so consumers can stop once the queue is empty
+  void Close() {
+    const std::lock_guard lock{mMutex};
+    mClosed = true;
+    mNotEmpty.notify_all();
+  }
+
+ private:
+  std::size_t mCapacity;
+  std::size_t mBytes = 0;
+  bool mClosed = false;
+  std::deque<std::pair<T, std::size_t>> mItems;
+  std::mutex mMutex;
+  std::condition_variable mNotFull;
+  std::condition_variable mNotEmpty;
+};
+
+}  // namespace Zamboni
\ No newline at end of file
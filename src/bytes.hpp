@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+namespace Zamboni {
+
+// Read a little-endian integer at offset, throwing if it does not fit in data
+inline std::uint32_t ReadU32(std::span<const std::byte> data, std::size_t offset) {
+  if (offset > data.size() || data.size() - offset < 4) {
+    throw std::out_of_range{"Read past end of data"};
+  }
+
+  return std::to_integer<std::uint32_t>(data[offset]) | (std::to_integer<std::uint32_t>(data[offset + 1]) << 8) |
+         (std::to_integer<std::uint32_t>(data[offset + 2]) << 16) |
+         (std::to_integer<std::uint32_t>(data[offset + 3]) << 24);
+}
+
+inline std::int32_t ReadI32(std::span<const std::byte> data, std::size_t offset) {
+  return static_cast<std::int32_t>(ReadU32(data, offset));
+}
+
+inline void WriteU32(std::span<std::byte> data, std::size_t offset, std::uint32_t value) {
+  if (offset > data.size() || data.size() - offset < 4) {
+    throw std::out_of_range{"Write past end of data"};
+  }
+
+  for (auto i = 0; i < 4; i++) {
+    data[offset + i] = static_cast<std::byte>(value >> (8 * i));
+  }
+}
+
+}  // namespace Zamboni
\ No newline at end of file
@@ -1,48 +1,14 @@
-// Based on https://gist.github.com/timepp/1f678e200d9e0f2a043a9ec6b3690635
+#include "crc.hpp"
 
-#include "util.hpp"
-
-#define PY_SSIZE_T_CLEAN
-
-#include <Python.h>
-
-#include <algorithm>
-#include <array>
 #include <cstddef>
 #include <cstdint>
-#include <span>
 
-namespace {
-
-constexpr std::array<std::uint32_t, 256> GenerateTable() {
-  constexpr std::uint32_t Polynomial = 0xEDB88320;
-
-  std::array<std::uint32_t, 256> table{};
-  for (auto i = 0; i < table.size(); i++) {
-    std::uint32_t c = i;
-    for (auto j = 0; j < 8; j++) {
-      if (c & 1) {
-        c = Polynomial ^ (c >> 1);
-      } else {
-        c >>= 1;
-      }
-    }
-    table[i] = c;
-  }
-  return table;
-}
-
-constexpr auto Table = GenerateTable();
-
-std::uint32_t Update(std::span<const std::byte> data, std::uint32_t initial = 0) {
-  auto c = initial ^ 0xFFFFFFFF;
+#include "util.hpp"
 
-  for (const auto byte : data) {
-    c = Table[(c ^ static_cast<std::uint8_t>(byte)) & 0xFF] ^ (c >> 8);
-  }
+namespace {
 
-  return c ^ 0xFFFFFFFF;
-}
+// Releasing the GIL costs more than checksumming small buffers such as headers
+constexpr Py_ssize_t MinGilReleaseSize = 2048;
 
 PyObject* Crc32(PyObject* self, PyObject* args) {
   std::uint32_t checksum = 0;
@@ -60,7 +26,10 @@ PyObject* Crc32(PyObject* self, PyObject* args) {
       return nullptr;
     }
 
-    checksum = Update(AsSpan(buffer), checksum);
+    {
+      GilRelease nogil{buffer.len >= MinGilReleaseSize};
+      checksum = Zamboni::Crc::Update(AsSpan(buffer), checksum);
+    }
     PyBuffer_Release(&buffer);
   }
 
@@ -68,21 +37,131 @@ PyObject* Crc32(PyObject* self, PyObject* args) {
 }
 
 PyObject* Crc32Update(PyObject* self, PyObject* args) {
-  const std::byte* data;
-  Py_ssize_t dataSize;
+  PythonBuffer data;
   std::uint32_t initial;
 
-  if (!PyArg_ParseTuple(args, "y#I", &data, &dataSize, &initial)) {
+  if (!PyArg_ParseTuple(args, "y*I", &data, &initial)) {
     return nullptr;
   }
 
-  auto checksum = Update({data, static_cast<std::size_t>(dataSize)}, initial);
+  std::uint32_t checksum;
+  {
+    GilRelease nogil{(*data).len >= MinGilReleaseSize};
+    checksum = Zamboni::Crc::Update(AsSpan(*data), initial);
+  }
 
   return Py_BuildValue("I", checksum);
 }
 
+PyObject* Crc32Combine(PyObject* self, PyObject* args) {
+  std::uint32_t crcA;
+  std::uint32_t crcB;
+  Py_ssize_t sizeB;
+
+  if (!PyArg_ParseTuple(args, "IIn", &crcA, &crcB, &sizeB)) {
+    return nullptr;
+  }
+
+  if (sizeB < 0) {
+    PyErr_SetString(PyExc_ValueError, "size_b must not be negative");
+    return nullptr;
+  }
+
+  return Py_BuildValue("I", Zamboni::Crc::Combine(crcA, crcB, static_cast<std::uint64_t>(sizeB)));
+}
+
+struct Crc32Object {
+  PyObject_HEAD
+  std::uint32_t checksum;
+  unsigned long long size;
+};
+
+int Crc32Init(Crc32Object* self, PyObject* args, PyObject* kwds) {
+  static char InitialArg[] = "initial";
+  static char* kwlist[] = {InitialArg, nullptr};
+
+  std::uint32_t initial = 0;
+  if (!PyArg_ParseTupleAndKeywords(args, kwds, "|I", kwlist, &initial)) {
+    return -1;
+  }
+
+  self->checksum = initial;
+  self->size = 0;
+  return 0;
+}
+
+PyObject* Crc32ObjectUpdate(Crc32Object* self, PyObject* args) {
+  PythonBuffer data;
+
+  if (!PyArg_ParseTuple(args, "y*", &data)) {
+    return nullptr;
+  }
+
+  std::uint32_t checksum;
+  {
+    GilRelease nogil{(*data).len >= MinGilReleaseSize};
+    checksum = Zamboni::Crc::Update(AsSpan(*data), self->checksum);
+  }
+
+  // Other threads may have used the object while the GIL was released, so only store the result afterwards
+  self->checksum = checksum;
+  self->size += (*data).len;
+  Py_RETURN_NONE;
+}
+
+PyObject* Crc32ObjectCombine(Crc32Object* self, PyObject* args) {
+  std::uint32_t checksum;
+  Py_ssize_t size;
+
+  if (!PyArg_ParseTuple(args, "In", &checksum, &size)) {
+    return nullptr;
+  }
+
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "size must not be negative");
+    return nullptr;
+  }
+
+  self->checksum = Zamboni::Crc::Combine(self->checksum, checksum, size);
+  self->size += size;
+  Py_RETURN_NONE;
+}
+
+PyObject* Crc32ObjectDigest(Crc32Object* self, PyObject*) { return Py_BuildValue("I", self->checksum); }
+
+PyObject* Crc32ObjectGetSize(Crc32Object* self, void*) { return PyLong_FromUnsignedLongLong(self->size); }
+
+PyMethodDef Crc32Methods[] = {
+    {"update", (PyCFunction)Crc32ObjectUpdate, METH_VARARGS, nullptr},
+    {"combine", (PyCFunction)Crc32ObjectCombine, METH_VARARGS, nullptr},
+    {"digest", (PyCFunction)Crc32ObjectDigest, METH_NOARGS, nullptr},
+    {},  // Sentinel
+};
+
+PyGetSetDef Crc32GetSet[] = {
+    {"size", (getter)Crc32ObjectGetSize, nullptr, nullptr, nullptr},
+    {},  // Sentinel
+};
+
+PyTypeObject Crc32Type = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "zamboni.crc.Crc32",
+    .tp_basicsize = sizeof(Crc32Object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_methods = Crc32Methods,
+    .tp_getset = Crc32GetSet,
+    .tp_init = (initproc)Crc32Init,
+    .tp_new = PyType_GenericNew,
+};
+
 PyMethodDef Methods[] = {
-    {"crc32", Crc32, METH_VARARGS, nullptr}, {},  // Sentinel
+    {"crc32", Crc32, METH_VARARGS, nullptr},
+    {"crc32_update", Crc32Update, METH_VARARGS, nullptr},
+    {"crc32_combine", Crc32Combine, METH_VARARGS, nullptr},
+    {"_stats", GetStats, METH_NOARGS, nullptr},
+    {"_set_stats_enabled", SetStatsEnabled, METH_VARARGS, nullptr},
+    {"_reset_stats", ResetStats, METH_NOARGS, nullptr},
+    {},  // Sentinel
 };
 
 PyModuleDef Module = {
@@ -94,4 +173,20 @@ PyModuleDef Module = {
 
 }  // namespace
 
-PyMODINIT_FUNC PyInit_crc() { return PyModule_Create(&Module); }
\ No newline at end of file
+PyMODINIT_FUNC PyInit_crc() {
+  if (PyType_Ready(&Crc32Type) < 0) {
+    return nullptr;
+  }
+
+  auto module = PyModule_Create(&Module);
+  if (!module) {
+    return nullptr;
+  }
+
+  if (PyModule_AddObjectRef(module, "Crc32", reinterpret_cast<PyObject*>(&Crc32Type)) < 0) {
+    Py_DECREF(module);
+    return nullptr;
+  }
+
+  return module;
+}
\ No newline at end of file
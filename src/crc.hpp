@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+namespace Zamboni {
+namespace Crc {
+
+// Update a CRC-32 (the zlib/PNG polynomial) with more data. Pass the checksum of the data so far as initial, or 0 to
+// start a new checksum.
+std::uint32_t Update(std::span<const std::byte> data, std::uint32_t initial = 0);
+
+// Get the CRC-32 of two buffers joined together from the checksum of each one and the size of the second
+std::uint32_t Combine(std::uint32_t crcA, std::uint32_t crcB, std::uint64_t sizeB);
+
+}  // namespace Crc
+}  // namespace Zamboni
\ No newline at end of file
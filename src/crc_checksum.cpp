@@ -0,0 +1,309 @@
+// Based on https://gist.github.com/timepp/1f678e200d9e0f2a043a9ec6b3690635
+
+#include "crc.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "stats.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ZAMBONI_CRC_PCLMUL
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && (defined(__linux__) || defined(__APPLE__))
+#define ZAMBONI_CRC_ARMV8
+#include <arm_acle.h>
+#ifdef __linux__
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+namespace Zamboni {
+namespace Crc {
+
+namespace {
+
+constexpr std::size_t SliceCount = 8;
+
+using Table = std::array<std::uint32_t, 256>;
+
+constexpr Table GenerateTable() {
+  constexpr std::uint32_t Polynomial = 0xEDB88320;
+
+  Table table{};
+  for (std::size_t i = 0; i < table.size(); i++) {
+    auto c = static_cast<std::uint32_t>(i);
+    for (auto j = 0; j < 8; j++) {
+      if (c & 1) {
+        c = Polynomial ^ (c >> 1);
+      } else {
+        c >>= 1;
+      }
+    }
+    table[i] = c;
+  }
+  return table;
+}
+
+// Tables[k][i] is the CRC of byte i followed by k zero bytes, which lets slicing-by-8 process 8 bytes with 8
+// independent lookups.
+constexpr std::array<Table, SliceCount> GenerateSliceTables() {
+  std::array<Table, SliceCount> tables{};
+  tables[0] = GenerateTable();
+
+  for (std::size_t k = 1; k < SliceCount; k++) {
+    for (std::size_t i = 0; i < 256; i++) {
+      const auto prev = tables[k - 1][i];
+      tables[k][i] = (prev >> 8) ^ tables[0][prev & 0xFF];
+    }
+  }
+  return tables;
+}
+
+constexpr auto Tables = GenerateSliceTables();
+
+std::uint32_t LoadU32(const std::byte* data) {
+  return std::to_integer<std::uint32_t>(data[0]) | (std::to_integer<std::uint32_t>(data[1]) << 8) |
+         (std::to_integer<std::uint32_t>(data[2]) << 16) | (std::to_integer<std::uint32_t>(data[3]) << 24);
+}
+
+// The kernels below operate on the CRC register, i.e. without the initial and final inversion.
+
+std::uint32_t UpdateTable(std::span<const std::byte> data, std::uint32_t c) {
+  auto cur = data.data();
+  auto size = data.size();
+
+  for (; size >= 8; cur += 8, size -= 8) {
+    const auto one = LoadU32(cur) ^ c;
+    const auto two = LoadU32(cur + 4);
+
+    c = Tables[7][one & 0xFF] ^ Tables[6][(one >> 8) & 0xFF] ^ Tables[5][(one >> 16) & 0xFF] ^ Tables[4][one >> 24] ^
+        Tables[3][two & 0xFF] ^ Tables[2][(two >> 8) & 0xFF] ^ Tables[1][(two >> 16) & 0xFF] ^ Tables[0][two >> 24];
+  }
+
+  for (; size > 0; cur++, size--) {
+    c = Tables[0][(c ^ std::to_integer<std::uint32_t>(*cur)) & 0xFF] ^ (c >> 8);
+  }
+
+  return c;
+}
+
+#ifdef ZAMBONI_CRC_PCLMUL
+
+#ifdef _MSC_VER
+#define ZAMBONI_TARGET_PCLMUL
+#else
+#define ZAMBONI_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#endif
+
+constexpr std::size_t MinFoldSize = 64;
+
+bool HasPclmul() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 1)) && (info[2] & (1 << 19));
+#else
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+ZAMBONI_TARGET_PCLMUL inline __m128i Load(const std::byte* data) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+}
+
+// Multiply both halves of x by their constants in k and add the next block
+ZAMBONI_TARGET_PCLMUL inline __m128i Fold(__m128i x, __m128i k, __m128i next) {
+  const auto lo = _mm_clmulepi64_si128(x, k, 0x00);
+  const auto hi = _mm_clmulepi64_si128(x, k, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+// Folds 64 bytes at a time with carry-less multiplication, then reduces to 32 bits with Barrett reduction. See
+// Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction". The constants are powers of x
+// modulo the bit-reflected CRC-32 polynomial. Requires at least 64 bytes and only consumes a multiple of 16 bytes.
+ZAMBONI_TARGET_PCLMUL std::uint32_t FoldPclmul(const std::byte* data, std::size_t size, std::uint32_t c) {
+  alignas(16) static constexpr std::uint64_t K1K2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static constexpr std::uint64_t K3K4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static constexpr std::uint64_t K5K0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static constexpr std::uint64_t Poly[] = {0x01db710641, 0x01f7011641};
+
+  auto x1 = _mm_xor_si128(Load(data), _mm_cvtsi32_si128(static_cast<int>(c)));
+  auto x2 = Load(data + 0x10);
+  auto x3 = Load(data + 0x20);
+  auto x4 = Load(data + 0x30);
+  data += 64;
+  size -= 64;
+
+  auto k = _mm_load_si128(reinterpret_cast<const __m128i*>(K1K2));
+  for (; size >= 64; data += 64, size -= 64) {
+    x1 = Fold(x1, k, Load(data));
+    x2 = Fold(x2, k, Load(data + 0x10));
+    x3 = Fold(x3, k, Load(data + 0x20));
+    x4 = Fold(x4, k, Load(data + 0x30));
+  }
+
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(K3K4));
+  x1 = Fold(x1, k, x2);
+  x1 = Fold(x1, k, x3);
+  x1 = Fold(x1, k, x4);
+
+  for (; size >= 16; data += 16, size -= 16) {
+    x1 = Fold(x1, k, Load(data));
+  }
+
+  // Fold 128 bits to 64 bits
+  const auto mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(K5K0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask);
+  x1 = _mm_clmulepi64_si128(x1, k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // Barrett reduction to 32 bits
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(Poly));
+  x2 = _mm_and_si128(x1, mask);
+  x2 = _mm_clmulepi64_si128(x2, k, 0x10);
+  x2 = _mm_and_si128(x2, mask);
+  x2 = _mm_clmulepi64_si128(x2, k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+std::uint32_t UpdatePclmul(std::span<const std::byte> data, std::uint32_t c) {
+  if (data.size() >= MinFoldSize) {
+    const auto foldSize = data.size() & ~std::size_t{0xF};
+    c = FoldPclmul(data.data(), foldSize, c);
+    data = data.subspan(foldSize);
+  }
+
+  return UpdateTable(data, c);
+}
+
+#endif  // ZAMBONI_CRC_PCLMUL
+
+#ifdef ZAMBONI_CRC_ARMV8
+
+#ifdef __clang__
+#define ZAMBONI_TARGET_CRC __attribute__((target("crc")))
+#else
+#define ZAMBONI_TARGET_CRC __attribute__((target("+crc")))
+#endif
+
+bool HasArmCrc() {
+#ifdef __APPLE__
+  return true;
+#else
+  return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#endif
+}
+
+// ARMv8 has instructions dedicated to this exact polynomial.
+ZAMBONI_TARGET_CRC std::uint32_t UpdateArmCrc(std::span<const std::byte> data, std::uint32_t c) {
+  auto cur = data.data();
+  auto size = data.size();
+
+  for (; size >= 8; cur += 8, size -= 8) {
+    std::uint64_t value;
+    std::memcpy(&value, cur, sizeof(value));
+    c = __crc32d(c, value);
+  }
+
+  for (; size > 0; cur++, size--) {
+    c = __crc32b(c, std::to_integer<std::uint8_t>(*cur));
+  }
+
+  return c;
+}
+
+#endif  // ZAMBONI_CRC_ARMV8
+
+using UpdateFunc = std::uint32_t (*)(std::span<const std::byte>, std::uint32_t);
+
+UpdateFunc SelectUpdate() {
+#if defined(ZAMBONI_CRC_PCLMUL)
+  if (HasPclmul()) {
+    return UpdatePclmul;
+  }
+#elif defined(ZAMBONI_CRC_ARMV8)
+  if (HasArmCrc()) {
+    return UpdateArmCrc;
+  }
+#endif
+  return UpdateTable;
+}
+
+// The CRC register is a vector over GF(2), and feeding it a zero bit is multiplying it by a 32x32 matrix. Each column
+// of a matrix is stored as a word, so Matrix[i] is the result for the register with only bit i set.
+using Matrix = std::array<std::uint32_t, 32>;
+
+constexpr std::uint32_t Multiply(const Matrix& matrix, std::uint32_t vector) {
+  std::uint32_t result = 0;
+  for (std::size_t i = 0; vector; i++, vector >>= 1) {
+    if (vector & 1) {
+      result ^= matrix[i];
+    }
+  }
+  return result;
+}
+
+constexpr Matrix Square(const Matrix& matrix) {
+  Matrix result{};
+  for (std::size_t i = 0; i < result.size(); i++) {
+    result[i] = Multiply(matrix, matrix[i]);
+  }
+  return result;
+}
+
+// ZeroBytes[k] feeds the register 2^k zero bytes
+constexpr std::array<Matrix, 64> GenerateZeroBytes() {
+  Matrix oneBit{};
+  oneBit[0] = 0xEDB88320;
+  for (std::size_t i = 1; i < oneBit.size(); i++) {
+    oneBit[i] = std::uint32_t{1} << (i - 1);
+  }
+
+  std::array<Matrix, 64> result{};
+  result[0] = Square(Square(Square(oneBit)));
+  for (std::size_t k = 1; k < result.size(); k++) {
+    result[k] = Square(result[k - 1]);
+  }
+  return result;
+}
+
+constexpr auto ZeroBytes = GenerateZeroBytes();
+
+}  // namespace
+
+std::uint32_t Combine(std::uint32_t crcA, std::uint32_t crcB, std::uint64_t sizeB) {
+  // Appending B to A is the same as appending len(B) zero bytes to A and adding the CRC of B. The inversions applied
+  // to each checksum cancel out the ones that appending zeros to the final value would need.
+  for (std::size_t k = 0; sizeB; k++, sizeB >>= 1) {
+    if (sizeB & 1) {
+      crcA = Multiply(ZeroBytes[k], crcA);
+    }
+  }
+  return crcA ^ crcB;
+}
+
+std::uint32_t Update(std::span<const std::byte> data, std::uint32_t initial) {
+  static const auto update = SelectUpdate();
+
+  const Stats::Timer timer{Stats::Stage::Crc, data.size()};
+  return update(data, initial ^ 0xFFFFFFFF) ^ 0xFFFFFFFF;
+}
+
+}  // namespace Crc
+}  // namespace Zamboni
\ No newline at end of file
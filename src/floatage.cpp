@@ -1,46 +1,56 @@
-#define PY_SSIZE_T_CLEAN
+#include "floatage.hpp"
 
-#include <Python.h>
-
-#include <algorithm>
 #include <cstddef>
-#include <ranges>
-#include <span>
-#include <vector>
+#include <cstdint>
+
+#include "util.hpp"
 
 namespace {
 
-std::vector<std::byte> Decrypt(std::span<const std::byte> input, std::uint32_t key) {
-  static constexpr auto Zero = std::byte{0};
-  static constexpr auto Shift = 16;
+PyObject* FloatageDecrypt(PyObject* self, PyObject* args) {
+  PythonBuffer data;
+  std::uint32_t key;
 
-  const auto xorByte = std::byte{((key >> Shift) ^ key) & 0xFF};
+  if (!PyArg_ParseTuple(args, "y*I", &data, &key)) {
+    return nullptr;
+  }
 
-  std::vector<std::byte> result{};
-  result.reserve(input.size());
+  auto result = PythonRef(PyBytes_FromStringAndSize(nullptr, (*data).len));
+  if (!result) {
+    return nullptr;
+  }
 
-  std::ranges::transform(input, std::back_inserter(result),
-                         [&](const std::byte b) { return b == Zero || b == xorByte ? b : b ^ xorByte; });
+  {
+    GilRelease nogil;
+    Zamboni::Floatage::Decrypt(AsSpan(*data), BytesAsSpan(*result), key);
+  }
 
-  return result;
+  return Py_NewRef(*result);
 }
 
-PyObject* FloatageDecrypt(PyObject* self, PyObject* args) {
-  const std::byte* data;
-  Py_ssize_t dataSize;
+PyObject* FloatageDecryptInPlace(PyObject* self, PyObject* args) {
+  PythonBuffer data;
   std::uint32_t key;
 
-  if (!PyArg_ParseTuple(args, "y#I", &data, &dataSize, &key)) {
+  if (!PyArg_ParseTuple(args, "w*I", &data, &key)) {
     return nullptr;
   }
 
-  const auto result = Decrypt({data, static_cast<std::size_t>(dataSize)}, key);
+  {
+    GilRelease nogil;
+    Zamboni::Floatage::Decrypt(AsSpan(*data), key);
+  }
 
-  return Py_BuildValue("y#", result.data(), result.size());
+  Py_RETURN_NONE;
 }
 
 PyMethodDef Methods[] = {
-    {"decrypt", FloatageDecrypt, METH_VARARGS, nullptr}, {},  // Sentinel
+    {"decrypt", FloatageDecrypt, METH_VARARGS, nullptr},
+    {"decrypt_inplace", FloatageDecryptInPlace, METH_VARARGS, nullptr},
+    {"_stats", GetStats, METH_NOARGS, nullptr},
+    {"_set_stats_enabled", SetStatsEnabled, METH_VARARGS, nullptr},
+    {"_reset_stats", ResetStats, METH_NOARGS, nullptr},
+    {},  // Sentinel
 };
 
 PyModuleDef Module = {
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace Zamboni {
+namespace Floatage {
+
+// Decrypt input into output, which may be the same buffer. Output must be at least as large as input.
+void Decrypt(std::span<const std::byte> input, std::span<std::byte> output, std::uint32_t key);
+
+inline void Decrypt(std::span<std::byte> data, std::uint32_t key) { Decrypt(data, data, key); }
+
+}  // namespace Floatage
+}  // namespace Zamboni
\ No newline at end of file
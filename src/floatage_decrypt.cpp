@@ -0,0 +1,132 @@
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+
+#include "floatage.hpp"
+#include "stats.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZAMBONI_FLOATAGE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ZAMBONI_FLOATAGE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace Zamboni {
+namespace Floatage {
+
+namespace {
+
+// Every byte is XORed with the key byte, except for bytes that are zero or equal to the key byte. This is its own
+// inverse, since those are exactly the bytes XOR would map to each other.
+
+void DecryptScalar(const std::byte* input, std::byte* output, std::size_t size, std::byte xorByte) {
+  static constexpr auto Zero = std::byte{0};
+
+  for (std::size_t i = 0; i < size; i++) {
+    const auto b = input[i];
+    output[i] = b == Zero || b == xorByte ? b : b ^ xorByte;
+  }
+}
+
+#ifdef ZAMBONI_FLOATAGE_X86
+
+#ifdef _MSC_VER
+#define ZAMBONI_TARGET_AVX2
+#else
+#define ZAMBONI_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+bool HasAvx2() {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, 7, 0);
+  // AVX2 also needs the OS to save YMM registers
+  return (info[1] & (1 << 5)) && (_xgetbv(0) & 0x6) == 0x6;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+void DecryptSse2(const std::byte* input, std::byte* output, std::size_t size, std::byte xorByte) {
+  const auto zero = _mm_setzero_si128();
+  const auto key = _mm_set1_epi8(static_cast<char>(xorByte));
+
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    const auto keep = _mm_or_si128(_mm_cmpeq_epi8(b, zero), _mm_cmpeq_epi8(b, key));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_xor_si128(b, _mm_andnot_si128(keep, key)));
+  }
+
+  DecryptScalar(input + i, output + i, size - i, xorByte);
+}
+
+ZAMBONI_TARGET_AVX2 void DecryptAvx2(const std::byte* input, std::byte* output, std::size_t size, std::byte xorByte) {
+  const auto zero = _mm256_setzero_si256();
+  const auto key = _mm256_set1_epi8(static_cast<char>(xorByte));
+
+  std::size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + i));
+    const auto keep = _mm256_or_si256(_mm256_cmpeq_epi8(b, zero), _mm256_cmpeq_epi8(b, key));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), _mm256_xor_si256(b, _mm256_andnot_si256(keep, key)));
+  }
+
+  DecryptSse2(input + i, output + i, size - i, xorByte);
+}
+
+#endif  // ZAMBONI_FLOATAGE_X86
+
+#ifdef ZAMBONI_FLOATAGE_NEON
+
+void DecryptNeon(const std::byte* input, std::byte* output, std::size_t size, std::byte xorByte) {
+  const auto zero = vdupq_n_u8(0);
+  const auto key = vdupq_n_u8(std::to_integer<std::uint8_t>(xorByte));
+
+  std::size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const auto b = vld1q_u8(reinterpret_cast<const std::uint8_t*>(input + i));
+    const auto keep = vorrq_u8(vceqq_u8(b, zero), vceqq_u8(b, key));
+    vst1q_u8(reinterpret_cast<std::uint8_t*>(output + i), veorq_u8(b, vbicq_u8(key, keep)));
+  }
+
+  DecryptScalar(input + i, output + i, size - i, xorByte);
+}
+
+#endif  // ZAMBONI_FLOATAGE_NEON
+
+using DecryptFunc = void (*)(const std::byte*, std::byte*, std::size_t, std::byte);
+
+DecryptFunc SelectDecrypt() {
+#if defined(ZAMBONI_FLOATAGE_X86)
+  return HasAvx2() ? DecryptAvx2 : DecryptSse2;
+#elif defined(ZAMBONI_FLOATAGE_NEON)
+  return DecryptNeon;
+#else
+  return DecryptScalar;
+#endif
+}
+
+}  // namespace
+
+void Decrypt(std::span<const std::byte> input, std::span<std::byte> output, std::uint32_t key) {
+  static constexpr auto Shift = 16;
+  static const auto decrypt = SelectDecrypt();
+
+  if (output.size() < input.size()) {
+    throw std::out_of_range{"Output is smaller than input"};
+  }
+
+  const Stats::Timer timer{Stats::Stage::Floatage, input.size()};
+  const auto xorByte = static_cast<std::byte>(((key >> Shift) ^ key) & 0xFF);
+  decrypt(input.data(), output.data(), input.size(), xorByte);
+}
+
+}  // namespace Floatage
+}  // namespace Zamboni
\ No newline at end of file
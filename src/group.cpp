@@ -0,0 +1,749 @@
+#include "group.hpp"
+
+#include <ooz.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "blowfish.hpp"
+#include "bytes.hpp"
+#include "crc.hpp"
+#include "floatage.hpp"
+#include "parallel.hpp"
+#include "prs.hpp"
+#include "stats.hpp"
+
+namespace Zamboni {
+namespace Group {
+
+namespace {
+
+constexpr auto PrsXorKey = std::byte{0x95};
+
+// Extra space for Kraken output that does not compress
+constexpr std::size_t KrakenOutputMargin = 0x10000;
+
+// Most that one byte of compressed data can decode to. A PRS copy of up to 256 bytes takes at least 3 bytes, and every
+// Kraken block starts with a 2 byte header.
+constexpr std::size_t MaxPrsRatio = 0x100;
+constexpr std::size_t MaxKrakenRatio = KrakenBlockSize / 2;
+
+bool IsCompressed(const GroupHeader& header, const ExtractOptions& options) {
+  return header.compressedSize && options.compression != Compression::None;
+}
+
+std::uint32_t FloatageKey(std::span<const std::byte> key) {
+  if (key.size() < 4) {
+    throw std::out_of_range{"Floatage key must be at least 4 bytes"};
+  }
+
+  return ReadU32(key, 0);
+}
+
+// Both ciphers work on each 8 byte block separately, so a group can be decrypted in pieces of whole blocks. groupSize
+// is the size of the whole group, which decides whether there is a second pass.
+void Decrypt(std::span<const std::byte> input, std::span<std::byte> output, const ExtractOptions& options,
+             std::size_t groupSize) {
+  if (options.v3Decrypt) {
+    std::ranges::copy(input, output.begin());
+  } else {
+    Floatage::Decrypt(input, output, FloatageKey(options.key1));
+  }
+
+  Blowfish::GetCipher(options.key1)->Decrypt(output);
+
+  if (!options.v3Decrypt && groupSize <= options.secondPassThreshold) {
+    Blowfish::GetCipher(options.key2)->Decrypt(output);
+  }
+}
+
+std::vector<std::byte> CompressKraken(std::span<const std::byte> input, int level) {
+  std::vector<std::byte> output(input.size() + KrakenOutputMargin);
+  const Stats::Timer timer{Stats::Stage::KrakenCompress, input.size()};
+
+  // Kraken_Compress() does not modify its input, despite the signature
+  const auto size = Kraken_Compress(const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(input.data())), input.size(),
+                                    reinterpret_cast<uint8_t*>(output.data()), level);
+  if (size < 0) {
+    throw std::out_of_range{"Failed to compress"};
+  }
+
+  output.resize(size);
+  return output;
+}
+
+// Each thread keeps its PRS compressor, so compressing many small groups doesn't set up new match finder tables for
+// every one of them
+std::vector<std::byte> CompressPrs(std::span<const std::byte> input, int level) {
+  thread_local std::unique_ptr<Prs::Compressor> compressor;
+
+  auto options = Prs::CompressOptions::FromLevel(level);
+  options.xorKey = PrsXorKey;
+  if (!compressor || compressor->Options() != options) {
+    compressor = std::make_unique<Prs::Compressor>(options);
+  }
+
+  const auto output = compressor->Compress(input);
+  return {output.begin(), output.end()};
+}
+
+std::vector<std::byte> CompressChunk(std::span<const std::byte> input, const CompressOptions& options) {
+  if (input.empty()) {
+    return {};
+  }
+
+  switch (options.compression) {
+    case Compression::Kraken:
+      return CompressKraken(input, options.level);
+
+    case Compression::Prs:
+      return CompressPrs(input, options.level);
+
+    case Compression::None:
+      break;
+  }
+
+  return {input.begin(), input.end()};
+}
+
+// Decrypt a whole stored group into scratch if it is encrypted. Returns the decrypted data.
+std::span<const std::byte> DecryptedInput(std::span<const std::byte> input, const ExtractOptions& options,
+                                          std::vector<std::byte>& scratch) {
+  if (!options.encrypted) {
+    return input;
+  }
+
+  scratch.resize(input.size());
+  Decrypt(input, scratch, options, input.size());
+  return std::span{scratch}.first(input.size());
+}
+
+// Decompress a decrypted group into output, which must be ExtractBufferSize() bytes. Returns the size of the result.
+std::size_t Decompress(std::span<const std::byte> data, const GroupHeader& header, const ExtractOptions& options,
+                       std::span<std::byte> output) {
+  switch (options.compression) {
+    case Compression::Kraken: {
+      const Stats::Timer timer{Stats::Stage::KrakenDecompress, header.originalSize};
+      const auto size = Kraken_Decompress(reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+                                          reinterpret_cast<uint8_t*>(output.data()), header.originalSize);
+      if (size < 0) {
+        throw std::out_of_range{"Failed to decompress"};
+      }
+
+      return size;
+    }
+
+    case Compression::Prs: {
+      const auto result = output.first(header.originalSize);
+      const auto size = Prs::Decompress(data, result, PrsXorKey);
+      std::fill(result.begin() + size, result.end(), std::byte{0});
+
+      return size;
+    }
+
+    case Compression::None:
+      break;
+  }
+
+  return 0;
+}
+
+// Size of a data file header without the file name
+constexpr std::size_t FileHeaderBaseSize = 0x40;
+constexpr std::string_view NiflSignature = "NIFL";
+
+// ICE files do not seem to allow uppercase characters, so assume that anything starting with a non-lowercase ASCII
+// character is missing a header.
+bool IsHeaderless(std::byte first) {
+  const auto c = std::to_integer<int>(first);
+  return (c < 32 || c > 64) && (c < 91 || c > 126);
+}
+
+bool StartsWith(std::span<const std::byte> data, std::string_view prefix) {
+  return data.size() >= prefix.size() &&
+         std::equal(prefix.begin(), prefix.end(), data.begin(), [](char a, std::byte b) { return std::byte(a) == b; });
+}
+
+std::string UnnamedFile(std::size_t index) { return "unnamed_" + std::to_string(index) + ".bin"; }
+
+std::size_t Clamp(std::int64_t offset, std::size_t end) {
+  if (offset < 0) {
+    throw std::out_of_range{"Data file offset is negative"};
+  }
+  return static_cast<std::size_t>(std::min<std::int64_t>(offset, end));
+}
+
+// Size of the pieces that uncompressed groups are passed to a FileSink in. This is a whole number of cipher blocks.
+constexpr std::size_t PieceSize = 0x40000;
+static_assert(PieceSize % Blowfish::BlockSize == 0);
+
+// Produces the next piece of a group, or an empty span at the end
+using Source = std::function<std::span<const std::byte>()>;
+
+// Reads an extracted group in order from pieces that are produced as it is decoded. If the source ends early, the rest
+// of the group reads as zeros, like Extract() fills it.
+class GroupReader {
+ public:
+  GroupReader(Source source, std::size_t size) : mSource{std::move(source)}, mSize{size} {}
+
+  std::size_t Position() const { return mPosition; }
+  std::size_t Size() const { return mSize; }
+
+  // Get the next count bytes without consuming them, or fewer at the end of the group. The result is valid until the
+  // reader is used again.
+  std::span<const std::byte> Peek(std::size_t count) {
+    count = std::min(count, mSize - mPosition);
+
+    if (mBuffered.empty() && mPiece.size() >= count) {
+      return mPiece.first(count);
+    }
+
+    // Gather the bytes from successive pieces
+    mBuffer.erase(mBuffer.begin(), mBuffer.end() - mBuffered.size());
+
+    while (mBuffer.size() < count) {
+      if (mPiece.empty()) {
+        mPiece = Next();
+      }
+
+      const auto part = mPiece.first(std::min(count - mBuffer.size(), mPiece.size()));
+      mBuffer.insert(mBuffer.end(), part.begin(), part.end());
+      mPiece = mPiece.subspan(part.size());
+    }
+
+    mBuffered = mBuffer;
+    return mBuffered.first(count);
+  }
+
+  // Pass the next count bytes to sink
+  void CopyTo(std::size_t count, FileSink& sink) {
+    Consume(count, [&](std::span<const std::byte> data) { sink.Write(data); });
+  }
+
+  // Skip to an offset, which cannot be before the current position
+  void Seek(std::size_t offset) {
+    if (offset < mPosition) {
+      throw std::out_of_range{"Data files overlap"};
+    }
+    Consume(offset - mPosition, [](std::span<const std::byte>) {});
+  }
+
+ private:
+  std::span<const std::byte> Next() {
+    static constexpr std::byte Zeros[0x1000]{};
+
+    const auto remaining = mSize - mPulled;
+    auto piece = mSource();
+    if (piece.empty()) {
+      piece = Zeros;
+    }
+
+    piece = piece.first(std::min(piece.size(), remaining));
+    mPulled += piece.size();
+    return piece;
+  }
+
+  template <class Fn>
+  void Consume(std::size_t count, Fn&& fn) {
+    if (count > mSize - mPosition) {
+      throw std::out_of_range{"Group data is truncated"};
+    }
+    mPosition += count;
+
+    const auto buffered = mBuffered.first(std::min(count, mBuffered.size()));
+    if (!buffered.empty()) {
+      fn(buffered);
+      mBuffered = mBuffered.subspan(buffered.size());
+      count -= buffered.size();
+    }
+
+    while (count > 0) {
+      if (mPiece.empty()) {
+        mPiece = Next();
+      }
+
+      const auto part = mPiece.first(std::min(count, mPiece.size()));
+      fn(part);
+      mPiece = mPiece.subspan(part.size());
+      count -= part.size();
+    }
+  }
+
+  Source mSource;
+  std::size_t mSize;
+  std::size_t mPosition = 0;
+  // Number of bytes taken from the source
+  std::size_t mPulled = 0;
+  // Unread part of the current piece
+  std::span<const std::byte> mPiece;
+  // Bytes gathered by Peek(), of which mBuffered are not consumed yet
+  std::vector<std::byte> mBuffer;
+  std::span<const std::byte> mBuffered;
+};
+
+// Pass the data file at the reader's position to sink, reading no further than end. Returns the offset of the next
+// file. A headerless file runs to end.
+std::size_t ReadFile(GroupReader& reader, std::size_t end, std::size_t index, FileSink& sink) {
+  const auto offset = reader.Position();
+  if (offset >= end) {
+    throw std::out_of_range{"Group data is truncated"};
+  }
+
+  if (IsHeaderless(reader.Peek(1)[0])) {
+    auto name = UnnamedFile(index);
+    if (!sink.Wants(name)) {
+      reader.Seek(end);
+      return end;
+    }
+
+    sink.Begin(std::move(name), offset);
+    reader.CopyTo(end - offset, sink);
+    sink.End();
+    return end;
+  }
+
+  if (end - offset < FileHeaderBaseSize) {
+    throw std::out_of_range{"Data file header is truncated"};
+  }
+
+  const auto header = reader.Peek(FileHeaderBaseSize);
+  const std::int64_t fileSize = ReadU32(header, 0x04);
+  const std::int64_t dataSize = ReadU32(header, 0x08);
+  const std::int64_t headerSize = ReadU32(header, 0x0C);
+  const std::int64_t filenameSize = ReadU32(header, 0x10);
+
+  const auto start = static_cast<std::int64_t>(offset);
+  const auto nameEnd = Clamp(start + FileHeaderBaseSize + filenameSize, end);
+  const auto nameBytes = reader.Peek(nameEnd - offset).subspan(FileHeaderBaseSize);
+
+  std::string name(reinterpret_cast<const char*>(nameBytes.data()), nameBytes.size());
+  name.erase(name.find_last_not_of('\0') + 1);
+
+  const auto dataStart = Clamp(start + headerSize, end);
+  const auto size = std::min<std::size_t>(dataSize, end - dataStart);
+  const auto next = Clamp(static_cast<std::int64_t>(dataStart + size) + fileSize - headerSize - dataSize, end);
+
+  if (next < dataStart + size) {
+    throw std::out_of_range{"Data files overlap"};
+  }
+
+  // Skipping uses the sizes in the header, so the data is passed over without being copied
+  if (!sink.Wants(name)) {
+    reader.Seek(next);
+    return next;
+  }
+
+  reader.Seek(dataStart);
+  sink.Begin(std::move(name), dataStart);
+  reader.CopyTo(size, sink);
+  sink.End();
+  reader.Seek(next);
+
+  return next;
+}
+
+// Groups of NIFL files have no data file headers, so each file's size comes from its NOF0 chunk. The chunk follows the
+// file's main data, so the size is only known once that has been passed on.
+void SplitHeaderlessNifl(const GroupHeader& header, GroupReader& reader, FileSink& sink) {
+  for (std::size_t i = 0; i < header.fileCount && !sink.Done(); i++) {
+    const auto offset = reader.Position();
+
+    if (!StartsWith(reader.Peek(NiflSignature.size()), NiflSignature)) {
+      // Nameless file for remaining file data
+      ReadFile(reader, reader.Size(), i, sink);
+      break;
+    }
+
+    const auto start = static_cast<std::int64_t>(offset);
+    std::int64_t size = ReadI32(reader.Peek(0x18), 0x14);
+
+    const auto nof0Offset = Clamp(start + size + 8, reader.Size());
+    if (nof0Offset < offset) {
+      throw std::out_of_range{"Data files overlap"};
+    }
+
+    // A NIFL file is headerless, so it is passed on whole
+    auto name = UnnamedFile(i);
+    const auto wanted = sink.Wants(name);
+    if (wanted) {
+      sink.Begin(std::move(name), offset);
+      reader.CopyTo(nof0Offset - offset, sink);
+    } else {
+      reader.Seek(nof0Offset);
+    }
+
+    std::int64_t nof0Size = ReadI32(reader.Peek(4), 0) + 8;
+
+    // Add padding bytes
+    nof0Size += 0x10 - ((nof0Size % 0x10) + 0x10) % 0x10;
+
+    // Add NOF0 size and NEND bytes
+    size += nof0Size + 0x10;
+
+    const auto end = Clamp(start + size, reader.Size());
+    if (end < nof0Offset) {
+      throw std::out_of_range{"Data files overlap"};
+    }
+
+    if (wanted) {
+      reader.CopyTo(end - nof0Offset, sink);
+      sink.End();
+    } else {
+      reader.Seek(end);
+    }
+  }
+}
+
+void SplitNormalGroup(const GroupHeader& header, GroupReader& reader, FileSink& sink) {
+  for (std::size_t i = 0; i < header.fileCount && !sink.Done(); i++) {
+    if (ReadFile(reader, reader.Size(), i, sink) == reader.Size()) {
+      break;
+    }
+  }
+}
+
+void SplitFiles(const GroupHeader& header, GroupReader& reader, FileSink& sink) {
+  if (reader.Size() == 0) {
+    return;
+  }
+
+  const auto start = reader.Peek(NiflSignature.size());
+
+  if (StartsWith(start, NiflSignature)) {
+    SplitHeaderlessNifl(header, reader, sink);
+    return;
+  }
+
+  if (IsHeaderless(start[0])) {
+    if (header.fileCount != 1) {
+      throw std::out_of_range{"Expected a single nameless file but header lists " + std::to_string(header.fileCount) +
+                              " files"};
+    }
+
+    auto name = UnnamedFile(0);
+    if (sink.Wants(name)) {
+      sink.Begin(std::move(name), 0);
+      reader.CopyTo(reader.Size(), sink);
+      sink.End();
+    }
+    return;
+  }
+
+  SplitNormalGroup(header, reader, sink);
+}
+
+// Source that produces data in pieces of at most PieceSize
+Source Pieces(std::span<const std::byte> data) {
+  return [data]() mutable {
+    const auto piece = data.first(std::min(data.size(), PieceSize));
+    data = data.subspan(piece.size());
+    return piece;
+  };
+}
+
+// Records where each file is instead of copying it
+class EntrySink final : public FileSink {
+ public:
+  void Begin(std::string name, std::size_t offset) override {
+    files.push_back({.name = std::move(name), .offset = offset, .size = 0});
+  }
+
+  void Write(std::span<const std::byte> data) override { files.back().size += data.size(); }
+
+  void End() override {}
+
+  std::vector<FileEntry> files;
+};
+
+// Copies the files with the given names, stopping once each one has been found
+class NamedSink final : public FileSink {
+ public:
+  explicit NamedSink(std::span<const std::string> names) : mRemaining{names.begin(), names.end()} {}
+
+  void Begin(std::string name, std::size_t /*offset*/) override {
+    std::erase(mRemaining, name);
+    files.emplace_back(std::move(name), std::vector<std::byte>{});
+  }
+
+  void Write(std::span<const std::byte> data) override {
+    auto& file = files.back().second;
+    file.insert(file.end(), data.begin(), data.end());
+  }
+
+  void End() override {}
+
+  bool Wants(std::string_view name) override { return std::ranges::find(mRemaining, name) != mRemaining.end(); }
+
+  bool Done() const override { return mRemaining.empty(); }
+
+  std::vector<std::pair<std::string, std::vector<std::byte>>> files;
+
+ private:
+  std::vector<std::string> mRemaining;
+};
+
+// Write the header for a file into output, which must be FileHeaderSize(name) bytes
+void WriteFileHeader(std::string_view name, std::size_t size, std::span<std::byte> output) {
+  // The extension is the part of the last path component after its last period, unless that is the first character
+  const auto filename = name.substr(name.find_last_of('/') + 1);
+  const auto period = filename.find_last_of('.');
+  const auto extension = period == std::string_view::npos || period == 0 ? std::string_view{}
+                                                                         : filename.substr(period + 1, 4);
+
+  std::fill(output.begin(), output.end(), std::byte{0});
+  std::ranges::transform(extension, output.begin(), [](char c) { return std::byte(c); });
+  WriteU32(output, 0x04, static_cast<std::uint32_t>(output.size() + size + FilePaddingSize(size)));
+  WriteU32(output, 0x08, static_cast<std::uint32_t>(size));
+  WriteU32(output, 0x0C, static_cast<std::uint32_t>(output.size()));
+  WriteU32(output, 0x10, static_cast<std::uint32_t>(name.size() + 1));
+  WriteU32(output, 0x14, 1);
+  std::ranges::transform(name, output.begin() + FileHeaderBaseSize, [](char c) { return std::byte(c); });
+}
+
+// Check a compressed group's header before anything is allocated for it, since it could ask for up to 4 GiB
+void CheckOriginalSize(const GroupHeader& header, const ExtractOptions& options) {
+  const auto ratio = options.compression == Compression::Kraken ? MaxKrakenRatio : MaxPrsRatio;
+  if (header.originalSize > header.compressedSize * ratio) {
+    throw std::out_of_range{"Original size " + std::to_string(header.originalSize) + " is too large for " +
+                            std::to_string(header.compressedSize) + " bytes of compressed data"};
+  }
+}
+
+}  // namespace
+
+std::size_t ExtractBufferSize(const GroupHeader& header, const ExtractOptions& options) {
+  if (!IsCompressed(header, options)) {
+    return header.StoredSize();
+  }
+
+  CheckOriginalSize(header, options);
+  return options.compression == Compression::Kraken ? header.originalSize + SAFE_SPACE : header.originalSize;
+}
+
+std::size_t Extract(std::span<const std::byte> input, const GroupHeader& header, const ExtractOptions& options,
+                    std::span<std::byte> output) {
+  if (input.size() < header.StoredSize()) {
+    throw std::out_of_range{"Group data is truncated"};
+  }
+  if (output.size() < ExtractBufferSize(header, options)) {
+    throw std::out_of_range{"Output buffer is too small"};
+  }
+
+  input = input.first(header.StoredSize());
+
+  if (!IsCompressed(header, options)) {
+    // Everything happens in the output buffer
+    const auto result = output.first(input.size());
+
+    if (options.encrypted) {
+      Decrypt(input, result, options, input.size());
+    } else {
+      std::ranges::copy(input, result.begin());
+    }
+
+    return result.size();
+  }
+
+  // Decrypting needs a writable copy of the input
+  std::vector<std::byte> scratch{};
+  const auto size = Decompress(DecryptedInput(input, options, scratch), header, options, output);
+
+  // Decompress() fills the rest of a short PRS group with zeros
+  return options.compression == Compression::Prs ? header.originalSize : size;
+}
+
+std::uint32_t Verify(std::span<const std::byte> input, const GroupHeader& header, const ExtractOptions& options,
+                     VerifyBuffers& buffers) {
+  if (input.size() < header.StoredSize()) {
+    throw std::out_of_range{"Group data is truncated"};
+  }
+
+  const auto data = DecryptedInput(input.first(header.StoredSize()), options, buffers.decrypted);
+  const auto checksum = Crc::Update(data);
+
+  if (IsCompressed(header, options)) {
+    // Only grow the buffer, so it is not cleared again for every group
+    const auto bufferSize = ExtractBufferSize(header, options);
+    if (buffers.output.size() < bufferSize) {
+      buffers.output.resize(bufferSize);
+    }
+
+    const auto size = Decompress(data, header, options, buffers.output);
+    if (size != header.originalSize) {
+      throw std::out_of_range{"Decompressed " + std::to_string(size) + " bytes but header says " +
+                              std::to_string(header.originalSize)};
+    }
+  }
+
+  return checksum;
+}
+
+std::vector<std::vector<std::byte>> Compress(std::span<const std::span<const std::byte>> groups,
+                                             const CompressOptions& options) {
+  struct Chunk {
+    std::size_t group;
+    std::span<const std::byte> input;
+    std::vector<std::byte> output;
+  };
+
+  // A PRS stream cannot be split, but Kraken groups can be compressed in chunks to use more threads
+  const auto chunkSize = options.compression == Compression::Kraken && options.threads != 1
+                             ? KrakenChunkSize
+                             : std::numeric_limits<std::size_t>::max();
+
+  std::vector<Chunk> chunks{};
+  for (std::size_t group = 0; group < groups.size(); group++) {
+    auto input = groups[group];
+    do {
+      const auto size = std::min(input.size(), chunkSize);
+      chunks.push_back({.group = group, .input = input.first(size), .output = {}});
+      input = input.subspan(size);
+    } while (!input.empty());
+  }
+
+  // Start the largest chunks first so that the last one to finish is small
+  std::vector<Chunk*> order{};
+  for (auto& chunk : chunks) {
+    order.push_back(&chunk);
+  }
+  std::ranges::stable_sort(order, std::ranges::greater{}, [](const Chunk* chunk) { return chunk->input.size(); });
+
+  ParallelFor(order.size(), options.threads,
+              [&](std::size_t i) { order[i]->output = CompressChunk(order[i]->input, options); });
+
+  std::vector<std::vector<std::byte>> result(groups.size());
+  for (auto& chunk : chunks) {
+    auto& output = result[chunk.group];
+    if (output.empty()) {
+      output = std::move(chunk.output);
+    } else {
+      output.insert(output.end(), chunk.output.begin(), chunk.output.end());
+    }
+  }
+
+  return result;
+}
+
+void ExtractFiles(std::span<const std::byte> input, const GroupHeader& header, const ExtractOptions& options,
+                  FileSink& sink) {
+  if (input.size() < header.StoredSize()) {
+    throw std::out_of_range{"Group data is truncated"};
+  }
+
+  input = input.first(header.StoredSize());
+
+  if (!IsCompressed(header, options)) {
+    if (!options.encrypted) {
+      GroupReader reader{Pieces(input), input.size()};
+      SplitFiles(header, reader, sink);
+      return;
+    }
+
+    std::vector<std::byte> piece(std::min(input.size(), PieceSize));
+    auto remaining = input;
+
+    GroupReader reader{[&] {
+                         const auto size = std::min(remaining.size(), piece.size());
+                         const auto result = std::span{piece}.first(size);
+                         Decrypt(remaining.first(size), result, options, input.size());
+                         remaining = remaining.subspan(size);
+                         return std::span<const std::byte>{result};
+                       },
+                       input.size()};
+    SplitFiles(header, reader, sink);
+    return;
+  }
+
+  if (options.compression == Compression::Kraken) {
+    // Kraken can only decode a whole group at once
+    std::vector<std::byte> output(ExtractBufferSize(header, options));
+    output.resize(Extract(input, header, options, output));
+
+    GroupReader reader{Pieces(output), output.size()};
+    SplitFiles(header, reader, sink);
+    return;
+  }
+
+  CheckOriginalSize(header, options);
+
+  // Decrypting needs a writable copy of the input
+  std::vector<std::byte> scratch{};
+  const auto data = DecryptedInput(input, options, scratch);
+
+  Prs::StreamDecompressor decompressor{data, header.originalSize, PrsXorKey};
+
+  GroupReader reader{[&] { return decompressor.Read(); }, header.originalSize};
+  SplitFiles(header, reader, sink);
+}
+
+std::vector<std::pair<std::string, std::vector<std::byte>>> ExtractNamed(std::span<const std::byte> input,
+                                                                         const GroupHeader& header,
+                                                                         const ExtractOptions& options,
+                                                                         std::span<const std::string> names) {
+  NamedSink sink{names};
+  if (!sink.Done()) {
+    ExtractFiles(input, header, options, sink);
+  }
+  return std::move(sink.files);
+}
+
+std::vector<FileEntry> Split(const GroupHeader& header, std::span<const std::byte> data) {
+  const Stats::Timer timer{Stats::Stage::Split, data.size()};
+  EntrySink sink;
+  GroupReader reader{Pieces(data), data.size()};
+  SplitFiles(header, reader, sink);
+  return std::move(sink.files);
+}
+
+std::size_t CombinedSize(std::span<const FileData> files) {
+  std::size_t size = 0;
+  for (const auto& file : files) {
+    size += FileHeaderSize(file.name) + file.data.size() + FilePaddingSize(file.data.size());
+  }
+  return size;
+}
+
+void Combine(std::span<const FileData> files, std::span<std::byte> output) {
+  if (output.size() != CombinedSize(files)) {
+    throw std::out_of_range{"Output buffer does not match the group size"};
+  }
+
+  const Stats::Timer timer{Stats::Stage::Combine, output.size()};
+  auto dest = output.begin();
+
+  for (const auto& file : files) {
+    const auto header = std::span{dest, FileHeaderSize(file.name)};
+    WriteFileHeader(file.name, file.data.size(), header);
+    dest += header.size();
+
+    dest = std::ranges::copy(file.data, dest).out;
+
+    const auto padding = FilePaddingSize(file.data.size());
+    std::fill_n(dest, padding, std::byte{0});
+    dest += padding;
+  }
+}
+
+std::size_t FileHeaderSize(std::string_view name) {
+  const auto size = FileHeaderBaseSize + name.size() + 1;
+  return size + FilePaddingSize(size);
+}
+
+std::vector<std::byte> FileHeader(std::string_view name, std::size_t size) {
+  std::vector<std::byte> header(FileHeaderSize(name));
+  WriteFileHeader(name, size, header);
+  return header;
+}
+
+}  // namespace Group
+}  // namespace Zamboni
\ No newline at end of file
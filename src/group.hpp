@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Zamboni {
+namespace Group {
+
+enum class Compression { None, Kraken, Prs };
+
+// Kraken decodes in 256 KiB blocks, and a block may refer back to anything decoded before it. Streams compressed
+// separately can therefore be concatenated as long as every stream but the last is a whole number of blocks.
+constexpr std::size_t KrakenBlockSize = 0x40000;
+// Size of the pieces that large Kraken groups are compressed in when using more than one thread
+constexpr std::size_t KrakenChunkSize = 8 * KrakenBlockSize;
+
+struct GroupHeader {
+  std::uint32_t originalSize = 0;
+  std::uint32_t compressedSize = 0;
+  std::uint32_t fileCount = 0;
+  std::uint32_t crc32 = 0;
+
+  // Size of the data as stored in the ICE archive
+  std::size_t StoredSize() const { return compressedSize ? compressedSize : originalSize; }
+};
+
+struct ExtractOptions {
+  Compression compression = Compression::None;
+  bool encrypted = false;
+  std::span<const std::byte> key1;
+  std::span<const std::byte> key2;
+  std::size_t secondPassThreshold = 0;
+  bool v3Decrypt = false;
+};
+
+struct CompressOptions {
+  Compression compression = Compression::Kraken;
+  int level = 3;
+  // Number of worker threads, or 0 for one per core. With more than one thread, large Kraken groups are split into
+  // chunks that are compressed independently.
+  int threads = 1;
+};
+
+// A data file in an extracted group
+struct FileEntry {
+  // UTF-8 file name
+  std::string name;
+  // Location of the file data in the group, not including its header
+  std::size_t offset = 0;
+  std::size_t size = 0;
+};
+
+// A data file to add to a group
+struct FileData {
+  // UTF-8 file name
+  std::string_view name;
+  std::span<const std::byte> data;
+};
+
+// Receives the files of a group one piece at a time
+class FileSink {
+ public:
+  virtual ~FileSink() = default;
+
+  // Start a file whose data begins at offset in the extracted group
+  virtual void Begin(std::string name, std::size_t offset) = 0;
+  virtual void Write(std::span<const std::byte> data) = 0;
+  virtual void End() = 0;
+
+  // Return false to skip a file. Its data is passed over without being copied.
+  virtual bool Wants(std::string_view /*name*/) { return true; }
+  // Return true once no more files are needed, which stops decoding the group
+  virtual bool Done() const { return false; }
+};
+
+// Size of the output buffer Extract() needs. This may be larger than the extracted data. Throws std::out_of_range if
+// the original size is more than the compressed data could decode to.
+std::size_t ExtractBufferSize(const GroupHeader& header, const ExtractOptions& options);
+
+// Decrypt and decompress a group as stored in an ICE archive. Returns the size of the extracted data.
+std::size_t Extract(std::span<const std::byte> input, const GroupHeader& header, const ExtractOptions& options,
+                    std::span<std::byte> output);
+
+// Buffers reused by Verify() between groups
+struct VerifyBuffers {
+  std::vector<std::byte> decrypted;
+  std::vector<std::byte> output;
+};
+
+// Decrypt and decompress a group without keeping the result, to check that it decodes. Returns the CRC-32 of the
+// stored data after decryption, which is what the group header's checksum covers. Throws std::out_of_range if the group
+// is truncated or does not decompress to its original size.
+std::uint32_t Verify(std::span<const std::byte> input, const GroupHeader& header, const ExtractOptions& options,
+                     VerifyBuffers& buffers);
+
+// Compress groups for an ICE archive. Empty groups stay empty.
+std::vector<std::vector<std::byte>> Compress(std::span<const std::span<const std::byte>> groups,
+                                             const CompressOptions& options);
+
+// Extract a group and split it like Extract() and Split(), passing the files to sink as the group is decoded. PRS and
+// uncompressed groups are decoded in pieces, so the memory used does not grow with the size of the group. Kraken can
+// only decode a whole group at once.
+void ExtractFiles(std::span<const std::byte> input, const GroupHeader& header, const ExtractOptions& options,
+                  FileSink& sink);
+
+// Extract the files with the given names from a group, like ExtractFiles(). Each name is extracted once, from its
+// first occurrence. Other files are skipped, and PRS and uncompressed groups are only decoded as far as the last file
+// that was found.
+std::vector<std::pair<std::string, std::vector<std::byte>>> ExtractNamed(std::span<const std::byte> input,
+                                                                         const GroupHeader& header,
+                                                                         const ExtractOptions& options,
+                                                                         std::span<const std::string> names);
+
+// Find the data files in an extracted group
+std::vector<FileEntry> Split(const GroupHeader& header, std::span<const std::byte> data);
+
+// Size of a group containing the given files
+std::size_t CombinedSize(std::span<const FileData> files);
+
+// Write files with their data file headers and padding into a group, which must be CombinedSize() bytes
+void Combine(std::span<const FileData> files, std::span<std::byte> output);
+
+// Size of the data file header for a file with the given name, including the padding before the data
+std::size_t FileHeaderSize(std::string_view name);
+
+// Data file header for a file with the given name and data size, including the padding before the data
+std::vector<std::byte> FileHeader(std::string_view name, std::size_t size);
+
+// Padding after the data of a file with the given size
+constexpr std::size_t FilePaddingSize(std::size_t size) { return (0x10 - size % 0x10) % 0x10; }
+
+}  // namespace Group
+}  // namespace Zamboni
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include "ice.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "blowfish.hpp"
+#include "bytes.hpp"
+#include "crc.hpp"
+#include "parallel.hpp"
+#include "stats.hpp"
+
+namespace Zamboni {
+namespace Ice {
+
+namespace {
+
+constexpr std::uint32_t Signature = 0x00454349;  // "ICE\0"
+constexpr std::size_t SecondPassThreshold = 0x19000;
+
+// Version 3: header, group headers, group info, metadata, padding
+constexpr std::size_t V3GroupHeadersOffset = 0x10;
+constexpr std::size_t V3GroupInfoOffset = 0x30;
+constexpr std::size_t V3MetadataOffset = 0x40;
+constexpr std::size_t V3DataOffset = 0x80;
+
+// Version 4: header, metadata, encryption keys, group headers
+constexpr std::size_t V4MetadataOffset = 0x10;
+constexpr std::size_t V4KeysOffset = 0x20;
+constexpr std::size_t V4KeysSize = 0x100;
+constexpr std::size_t V4GroupHeadersOffset = 0x120;
+constexpr std::size_t V4GroupHeadersSize = 0x30;
+constexpr std::size_t V4DataOffset = 0x150;
+
+constexpr std::uint32_t MetadataMagic = 0xFF;
+constexpr std::uint32_t KrakenFlag = 0x08;
+constexpr std::uint32_t HeaderMagic = 0x80;
+
+// Size of the batches that uncompressed groups are copied in
+constexpr std::size_t CopyBatchSize = 0x100000;
+
+Key ToKey(std::uint32_t value) {
+  Key key;
+  WriteU32(key, 0, value);
+  return key;
+}
+
+std::uint32_t GetKey(std::span<const std::byte> magic, std::uint32_t tempKey) {
+  const auto num1 = static_cast<std::uint8_t>((tempKey & 0xFF) + 93);
+  const auto num2 = static_cast<std::uint8_t>((tempKey >> 8) + 63);
+  const auto num3 = static_cast<std::uint8_t>((tempKey >> 16) + 69);
+  const auto num4 = static_cast<std::uint8_t>((tempKey >> 24) - 58);
+
+  auto rotl = [&](std::uint8_t index, int shift) {
+    return static_cast<std::uint32_t>(std::rotl(std::to_integer<std::uint8_t>(magic[index]), shift));
+  };
+
+  return (rotl(num2, 7) << 24) | (rotl(num4, 6) << 16) | (rotl(num1, 5) << 8) | rotl(num3, 5);
+}
+
+std::uint32_t CalcBlowfishKey(std::span<const std::byte> magic, std::uint32_t tempKey) {
+  auto key = 0x8E02C25C ^ tempKey;
+
+  const auto rounds = key % 7 + 2;
+  for (std::uint32_t i = 0; i < rounds; i++) {
+    key = GetKey(magic, key);
+  }
+
+  return key ^ 0x4352F5C2 ^ 0xCD50379E;
+}
+
+Group::GroupHeader ReadGroupHeader(std::span<const std::byte> data, std::size_t offset) {
+  return {
+      .originalSize = ReadU32(data, offset),
+      .compressedSize = ReadU32(data, offset + 4),
+      .fileCount = ReadU32(data, offset + 8),
+      .crc32 = ReadU32(data, offset + 12),
+  };
+}
+
+Metadata ReadMetadata(std::span<const std::byte> data, std::size_t offset) {
+  return {
+      .crc32 = ReadU32(data, offset + 4),
+      .flags = ReadU32(data, offset + 8),
+      .fileSize = ReadU32(data, offset + 12),
+  };
+}
+
+// Lay out the groups one after the other starting at offset
+void LocateGroups(Archive& archive, std::span<const std::byte> data, std::size_t offset) {
+  for (auto& group : archive.groups) {
+    offset = std::min(offset, data.size());
+    const auto size = std::min(group.header.StoredSize(), data.size() - offset);
+
+    group.data = data.subspan(offset, size);
+    offset += size;
+  }
+}
+
+Archive ParseV3(std::span<const std::byte> data) {
+  Archive archive{.version = 3, .meta = ReadMetadata(data, V3MetadataOffset), .groups = {}};
+
+  auto& group1 = archive.groups[0].header;
+  auto& group2 = archive.groups[1].header;
+  group1 = ReadGroupHeader(data, V3GroupHeadersOffset);
+  group2 = ReadGroupHeader(data, V3GroupHeadersOffset + 0x10);
+
+  const auto group1Size = ReadU32(data, V3GroupInfoOffset);
+  const auto group2Size = ReadU32(data, V3GroupInfoOffset + 4);
+  const auto infoKey = ReadU32(data, V3GroupInfoOffset + 12);
+
+  // Both groups use the same key, and there is no second pass
+  const auto key = group1Size ? group1Size
+                              : group1.originalSize ^ group2.originalSize ^ group2Size ^ infoKey ^ 0xC8D7469A;
+  for (auto& group : archive.groups) {
+    group.keys = {ToKey(key), Key{}};
+  }
+
+  LocateGroups(archive, data, V3DataOffset);
+  return archive;
+}
+
+Archive ParseV4(std::span<const std::byte> data) {
+  Archive archive{.version = 4, .meta = ReadMetadata(data, V4MetadataOffset), .groups = {}};
+
+  if (data.size() < V4DataOffset) {
+    throw std::out_of_range{"ICE header is truncated"};
+  }
+
+  const auto keys = GetBlowfishKeys(data.subspan(V4KeysOffset, V4KeysSize), archive.meta.fileSize);
+  archive.groups[0].keys = keys.group1;
+  archive.groups[1].keys = keys.group2;
+
+  std::array<std::byte, V4GroupHeadersSize> headers;
+  std::ranges::copy(data.subspan(V4GroupHeadersOffset, V4GroupHeadersSize), headers.begin());
+
+  if (archive.meta.Encrypted()) {
+    Blowfish::GetCipher(keys.groupHeaders)->Decrypt(headers);
+  }
+
+  archive.groups[0].header = ReadGroupHeader(headers, 0);
+  archive.groups[1].header = ReadGroupHeader(headers, 0x10);
+
+  LocateGroups(archive, data, V4DataOffset);
+  return archive;
+}
+
+void WriteGroupHeader(std::span<std::byte> data, std::size_t offset, const Group::GroupHeader& header) {
+  WriteU32(data, offset, header.originalSize);
+  WriteU32(data, offset + 4, header.compressedSize);
+  WriteU32(data, offset + 8, header.fileCount);
+  WriteU32(data, offset + 12, header.crc32);
+}
+
+// Produces the data of a group from the headers and contents of its files, opening each file when it is reached
+class GroupBuilder {
+ public:
+  explicit GroupBuilder(std::span<const PackFile> files) : mFiles{files} {
+    for (const auto& file : files) {
+      const auto size = std::filesystem::file_size(file.path);
+      mSizes.push_back(size);
+      mSize += Group::FileHeaderSize(file.name) + size + Group::FilePaddingSize(size);
+    }
+
+    if (mSize > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::out_of_range{"Group is too large"};
+    }
+  }
+
+  // Size of the whole group
+  std::size_t Size() const { return mSize; }
+
+  // Fill output with the next part of the group. Returns the number of bytes written, which is only less than the size
+  // of output at the end of the group.
+  std::size_t Read(std::span<std::byte> output) {
+    std::size_t written = 0;
+
+    while (written < output.size()) {
+      const auto free = output.subspan(written);
+
+      if (mPendingOffset < mPending.size()) {
+        // Header or padding
+        const auto pending = std::span{mPending}.subspan(mPendingOffset);
+        const auto part = pending.first(std::min(free.size(), pending.size()));
+        std::ranges::copy(part, free.begin());
+        mPendingOffset += part.size();
+        written += part.size();
+      } else if (mRemaining > 0) {
+        const auto size = std::min(free.size(), mRemaining);
+        const Stats::Timer timer{Stats::Stage::Io, size};
+        if (!mFile.read(reinterpret_cast<char*>(free.data()), static_cast<std::streamsize>(size))) {
+          throw std::runtime_error{"Failed to read " + mFiles[mNext - 1].path.string()};
+        }
+        mRemaining -= size;
+        written += size;
+      } else if (mFile.is_open()) {
+        mFile.close();
+        SetPending(std::vector<std::byte>(Group::FilePaddingSize(mSizes[mNext - 1])));
+      } else if (mNext < mFiles.size()) {
+        const auto& file = mFiles[mNext];
+        mFile.open(file.path, std::ios::binary);
+        if (!mFile) {
+          throw std::runtime_error{"Failed to open " + file.path.string()};
+        }
+
+        mRemaining = mSizes[mNext];
+        SetPending(Group::FileHeader(file.name, mRemaining));
+        mNext++;
+      } else {
+        break;
+      }
+    }
+
+    return written;
+  }
+
+ private:
+  void SetPending(std::vector<std::byte> data) {
+    mPending = std::move(data);
+    mPendingOffset = 0;
+  }
+
+  std::span<const PackFile> mFiles;
+  std::vector<std::size_t> mSizes;
+  std::size_t mSize = 0;
+
+  // Index of the next file to open
+  std::size_t mNext = 0;
+  std::ifstream mFile;
+  // Bytes of the open file that are not read yet
+  std::size_t mRemaining = 0;
+  // Header or padding that is not copied yet
+  std::vector<std::byte> mPending;
+  std::size_t mPendingOffset = 0;
+};
+
+// Size of the pieces of a group to compress at once
+std::size_t BatchSize(const Group::CompressOptions& options) {
+  switch (options.compression) {
+    case Group::Compression::Kraken: {
+      // Kraken chunks are compressed independently, so a batch only needs enough of them to keep every thread busy
+      const auto threads = options.threads > 0 ? options.threads : DefaultThreadCount();
+      return Group::KrakenChunkSize * static_cast<std::size_t>(threads);
+    }
+
+    case Group::Compression::Prs:
+      return std::numeric_limits<std::size_t>::max();
+
+    case Group::Compression::None:
+      break;
+  }
+
+  return CopyBatchSize;
+}
+
+}  // namespace
+
+BlowfishKeys GetBlowfishKeys(std::span<const std::byte> magic, std::uint32_t fileSize) {
+  if (magic.size() < V4KeysSize) {
+    throw std::out_of_range{"Expected 0x100 bytes of magic numbers"};
+  }
+
+  const auto crc = Crc::Update(magic.subspan(0x7C, 0x60));
+  const auto key = GetKey(magic, crc ^ ReadU32(magic, 0x6C) ^ fileSize ^ 0x4352F5C2);
+
+  const auto group1Key0 = CalcBlowfishKey(magic, key);
+  const auto group1Key1 = GetKey(magic, group1Key0);
+
+  return {
+      .groupHeaders = ToKey(std::rotr(group1Key0, 19)),
+      .group1 = {ToKey(group1Key0), ToKey(group1Key1)},
+      .group2 = {ToKey(std::rotr(group1Key0, 15)), ToKey(std::rotr(group1Key1, 15))},
+  };
+}
+
+Group::ExtractOptions Archive::ExtractOptions(std::size_t group) const {
+  const auto& location = groups.at(group);
+
+  return {
+      .compression = meta.KrakenCompressed() ? Group::Compression::Kraken : Group::Compression::Prs,
+      .encrypted = meta.Encrypted(),
+      .key1 = location.keys[0],
+      .key2 = location.keys[1],
+      .secondPassThreshold = SecondPassThreshold,
+      .v3Decrypt = version == 3,
+  };
+}
+
+std::vector<std::byte> Archive::ExtractGroup(std::size_t group) const {
+  const auto& location = groups.at(group);
+  const auto options = ExtractOptions(group);
+
+  if (location.header.StoredSize() == 0) {
+    return {};
+  }
+
+  std::vector<std::byte> output(Group::ExtractBufferSize(location.header, options));
+  output.resize(Group::Extract(location.data, location.header, options, output));
+  return output;
+}
+
+Archive Parse(std::span<const std::byte> data) {
+  if (data.size() < 0x10 || ReadU32(data, 0) != Signature) {
+    throw std::out_of_range{"Not an ICE archive"};
+  }
+
+  const auto version = ReadU32(data, 8);
+  switch (version) {
+    case 3:
+      return ParseV3(data);
+    case 4:
+      return ParseV4(data);
+    default:
+      throw std::out_of_range{"Unsupported version " + std::to_string(version)};
+  }
+}
+
+void WriteV4(const std::filesystem::path& output, std::array<std::span<const PackFile>, 2> groups,
+             const Group::CompressOptions& options) {
+  std::ofstream out{output, std::ios::binary | std::ios::trunc};
+  if (!out) {
+    throw std::runtime_error{"Failed to create " + output.string()};
+  }
+
+  auto write = [&](std::span<const std::byte> data) {
+    const Stats::Timer timer{Stats::Stage::Io, data.size()};
+    if (!out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+      throw std::runtime_error{"Failed to write " + output.string()};
+    }
+  };
+
+  try {
+    // The headers need the sizes and checksums of the groups, so they are written last
+    std::array<std::byte, V4DataOffset> headers{};
+    write(headers);
+
+    std::array<Group::GroupHeader, 2> groupHeaders{};
+    std::array<std::size_t, 2> storedSizes{};
+    std::vector<std::byte> batch{};
+
+    for (std::size_t i = 0; i < groups.size(); i++) {
+      GroupBuilder builder{groups[i]};
+      batch.resize(std::min(BatchSize(options), builder.Size()));
+
+      auto& header = groupHeaders[i];
+      auto& stored = storedSizes[i];
+
+      while (const auto size = builder.Read(batch)) {
+        const auto input = std::span<const std::byte>{batch}.first(size);
+
+        if (options.compression == Group::Compression::None) {
+          write(input);
+          header.crc32 = Crc::Update(input, header.crc32);
+          stored += input.size();
+          continue;
+        }
+
+        const auto compressed = Group::Compress({&input, 1}, options);
+        write(compressed[0]);
+        header.crc32 = Crc::Update(compressed[0], header.crc32);
+        stored += compressed[0].size();
+      }
+
+      header.originalSize = static_cast<std::uint32_t>(builder.Size());
+      header.compressedSize = stored != builder.Size() ? static_cast<std::uint32_t>(stored) : 0;
+      header.fileCount = static_cast<std::uint32_t>(groups[i].size());
+    }
+
+    const auto fileSize = V4DataOffset + storedSizes[0] + storedSizes[1];
+    if (fileSize > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::out_of_range{"Archive is too large"};
+    }
+
+    WriteU32(headers, 0, Signature);
+    WriteU32(headers, 8, 4);
+    WriteU32(headers, 12, HeaderMagic);
+
+    WriteU32(headers, V4MetadataOffset, MetadataMagic);
+    WriteU32(headers, V4MetadataOffset + 4, Crc::Combine(groupHeaders[0].crc32, groupHeaders[1].crc32, storedSizes[1]));
+    WriteU32(headers, V4MetadataOffset + 8, options.compression == Group::Compression::Kraken ? KrakenFlag : 0);
+    WriteU32(headers, V4MetadataOffset + 12, static_cast<std::uint32_t>(fileSize));
+
+    WriteGroupHeader(headers, V4GroupHeadersOffset, groupHeaders[0]);
+    WriteGroupHeader(headers, V4GroupHeadersOffset + 0x10, groupHeaders[1]);
+
+    out.seekp(0);
+    write(headers);
+
+    out.close();
+    if (!out) {
+      throw std::runtime_error{"Failed to write " + output.string()};
+    }
+  } catch (...) {
+    // Don't leave a partial archive behind
+    out.close();
+    std::error_code error;
+    std::filesystem::remove(output, error);
+    throw;
+  }
+}
+
+}  // namespace Ice
+}  // namespace Zamboni
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "group.hpp"
+
+namespace Zamboni {
+namespace Ice {
+
+using Key = std::array<std::byte, 4>;
+
+struct BlowfishKeys {
+  Key groupHeaders{};
+  std::array<Key, 2> group1{};
+  std::array<Key, 2> group2{};
+};
+
+// Get the Blowfish keys from the magic numbers in a version 4 header
+BlowfishKeys GetBlowfishKeys(std::span<const std::byte> magic, std::uint32_t fileSize);
+
+struct Metadata {
+  std::uint32_t crc32 = 0;
+  std::uint32_t flags = 0;
+  std::uint32_t fileSize = 0;
+
+  bool Encrypted() const { return flags & 0x01; }
+  bool KrakenCompressed() const { return flags & 0x08; }
+};
+
+// Location of a group in an archive, and how to extract it
+struct GroupLocation {
+  Group::GroupHeader header;
+  // Stored group data, which may be shorter than the header says if the archive is truncated
+  std::span<const std::byte> data;
+  std::array<Key, 2> keys{};
+};
+
+// An ICE archive parsed from a buffer. The groups refer to the buffer, so it must outlive the archive.
+struct Archive {
+  std::uint32_t version = 0;
+  Metadata meta;
+  std::array<GroupLocation, 2> groups;
+
+  // Options for Group::Extract() for one of the groups
+  Group::ExtractOptions ExtractOptions(std::size_t group) const;
+
+  // Decrypt and decompress one of the groups
+  std::vector<std::byte> ExtractGroup(std::size_t group) const;
+};
+
+// Parse the headers of a version 3 or 4 ICE archive. Throws std::out_of_range if the data is not a supported archive.
+Archive Parse(std::span<const std::byte> data);
+
+// A file to pack, which is read from disk as the archive is written
+struct PackFile {
+  // UTF-8 file name
+  std::string name;
+  std::filesystem::path path;
+};
+
+// Write an unencrypted version 4 archive. Each group is built from the file headers and contents as it is compressed,
+// and the compressed data is written as it is produced, so only one batch of a group is in memory at a time: a few
+// Kraken chunks, or a whole PRS group since a PRS stream cannot be split. The headers are filled in last by seeking
+// back. Throws std::out_of_range if the archive would be too large, or std::runtime_error if a file cannot be read or
+// written.
+void WriteV4(const std::filesystem::path& output, std::array<std::span<const PackFile>, 2> groups,
+             const Group::CompressOptions& options);
+
+}  // namespace Ice
+}  // namespace Zamboni
\ No newline at end of file
@@ -0,0 +1,807 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "batch.hpp"
+#include "group.hpp"
+#include "ice.hpp"
+#include "util.hpp"
+
+namespace {
+
+using Zamboni::Group::Compression;
+
+std::optional<Compression> ParseCompression(const char* mode) {
+  if (std::strcmp(mode, "none") == 0) {
+    return Compression::None;
+  }
+  if (std::strcmp(mode, "kraken") == 0) {
+    return Compression::Kraken;
+  }
+  if (std::strcmp(mode, "prs") == 0) {
+    return Compression::Prs;
+  }
+  return std::nullopt;
+}
+
+// Convert a str, bytes or os.PathLike object to a path
+bool ToPath(PyObject* obj, std::filesystem::path& path) {
+#ifdef _WIN32
+  auto fspath = PythonRef(PyOS_FSPath(obj));
+  if (!fspath) {
+    return false;
+  }
+  if (!PyUnicode_Check(*fspath)) {
+    PyErr_SetString(PyExc_TypeError, "Expected a str path");
+    return false;
+  }
+
+  Py_ssize_t size;
+  wchar_t* chars = PyUnicode_AsWideCharString(*fspath, &size);
+  if (!chars) {
+    return false;
+  }
+  path = std::wstring{chars, static_cast<std::size_t>(size)};
+  PyMem_Free(chars);
+#else
+  PyObject* bytes = nullptr;
+  if (!PyUnicode_FSConverter(obj, &bytes)) {
+    return false;
+  }
+  auto owned = PythonRef(bytes);
+  path = std::string{PyBytes_AS_STRING(bytes), static_cast<std::size_t>(PyBytes_GET_SIZE(bytes))};
+#endif
+  return true;
+}
+
+PyObject* FromPath(const std::filesystem::path& path) {
+#ifdef _WIN32
+  return PyUnicode_FromWideChar(path.c_str(), -1);
+#else
+  return PyUnicode_DecodeFSDefault(path.c_str());
+#endif
+}
+
+// Stage counters of one archive in a batch, or None if counting is off
+PyObject* ArchiveStats(const Zamboni::Stats::Counters& counters) {
+  if (!Zamboni::Stats::Enabled()) {
+    Py_RETURN_NONE;
+  }
+  return StatsToDict(counters);
+}
+
+// Fill in the options for extracting a group. The keys are held in key1 and key2, which must outlive the options.
+bool ParseExtractOptions(const char* mode, PyObject* keys, Py_ssize_t secondPassThreshold, int v3Decrypt,
+                         Zamboni::Group::ExtractOptions& options, PythonBuffer& key1, PythonBuffer& key2) {
+  if (const auto compression = ParseCompression(mode)) {
+    options.compression = *compression;
+  } else {
+    PyErr_Format(PyExc_ValueError, "Unknown compression mode '%s'", mode);
+    return false;
+  }
+
+  if (keys != Py_None) {
+    if (!PyArg_ParseTuple(keys, "y*y*", &key1, &key2)) {
+      return false;
+    }
+
+    options.encrypted = true;
+    options.key1 = AsSpan(*key1);
+    options.key2 = AsSpan(*key2);
+    options.secondPassThreshold = static_cast<std::size_t>(std::max<Py_ssize_t>(secondPassThreshold, 0));
+    options.v3Decrypt = v3Decrypt;
+  }
+
+  return true;
+}
+
+PyObject* ExtractGroup(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char OriginalSizeArg[] = "original_size";
+  static char CompressedSizeArg[] = "compressed_size";
+  static char ModeArg[] = "mode";
+  static char KeysArg[] = "keys";
+  static char SecondPassThresholdArg[] = "second_pass_threshold";
+  static char V3DecryptArg[] = "v3_decrypt";
+  static char* kwlist[] = {DataArg,  OriginalSizeArg,        CompressedSizeArg, ModeArg,
+                           KeysArg,  SecondPassThresholdArg, V3DecryptArg,      nullptr};
+
+  PythonBuffer data;
+  Zamboni::Group::GroupHeader header;
+  const char* mode = "kraken";
+  PyObject* keys = Py_None;
+  Py_ssize_t secondPassThreshold = 0;
+  int v3Decrypt = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*II|sOnp", kwlist, &data, &header.originalSize,
+                                   &header.compressedSize, &mode, &keys, &secondPassThreshold, &v3Decrypt)) {
+    return nullptr;
+  }
+
+  Zamboni::Group::ExtractOptions options;
+  PythonBuffer key1;
+  PythonBuffer key2;
+
+  if (!ParseExtractOptions(mode, keys, secondPassThreshold, v3Decrypt, options, key1, key2)) {
+    return nullptr;
+  }
+
+  std::size_t bufferSize;
+  try {
+    bufferSize = Zamboni::Group::ExtractBufferSize(header, options);
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  }
+
+  // The buffer is exactly the extracted size except for Kraken, which needs SAFE_SPACE bytes of slack, so only Kraken
+  // groups and short streams trim the bytes object afterwards. Trimming may reallocate and copy the data.
+  PyObject* result = PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(bufferSize));
+  if (!result) {
+    return nullptr;
+  }
+
+  std::size_t size;
+  try {
+    GilRelease nogil;
+    size = Zamboni::Group::Extract(AsSpan(*data), header, options, BytesAsSpan(result));
+  } catch (const std::out_of_range& ex) {
+    Py_DECREF(result);
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    Py_DECREF(result);
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    Py_DECREF(result);
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  if (size != bufferSize && _PyBytes_Resize(&result, static_cast<Py_ssize_t>(size)) < 0) {
+    return nullptr;
+  }
+
+  return result;
+}
+
+PyObject* ExtractFiles(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char OriginalSizeArg[] = "original_size";
+  static char CompressedSizeArg[] = "compressed_size";
+  static char FileCountArg[] = "file_count";
+  static char NamesArg[] = "names";
+  static char ModeArg[] = "mode";
+  static char KeysArg[] = "keys";
+  static char SecondPassThresholdArg[] = "second_pass_threshold";
+  static char V3DecryptArg[] = "v3_decrypt";
+  static char* kwlist[] = {DataArg, OriginalSizeArg, CompressedSizeArg,      FileCountArg, NamesArg,
+                           ModeArg, KeysArg,         SecondPassThresholdArg, V3DecryptArg, nullptr};
+
+  PythonBuffer data;
+  Zamboni::Group::GroupHeader header;
+  PyObject* namesArg;
+  const char* mode = "kraken";
+  PyObject* keys = Py_None;
+  Py_ssize_t secondPassThreshold = 0;
+  int v3Decrypt = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*IIIO|sOnp", kwlist, &data, &header.originalSize,
+                                   &header.compressedSize, &header.fileCount, &namesArg, &mode, &keys,
+                                   &secondPassThreshold, &v3Decrypt)) {
+    return nullptr;
+  }
+
+  Zamboni::Group::ExtractOptions options;
+  PythonBuffer key1;
+  PythonBuffer key2;
+
+  if (!ParseExtractOptions(mode, keys, secondPassThreshold, v3Decrypt, options, key1, key2)) {
+    return nullptr;
+  }
+
+  auto sequence = PythonRef(PySequence_Fast(namesArg, "Expected a sequence of file names"));
+  if (!sequence) {
+    return nullptr;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  std::vector<std::string> names(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    Py_ssize_t size;
+    const char* name = PyUnicode_AsUTF8AndSize(PySequence_Fast_GET_ITEM(*sequence, i), &size);
+    if (!name) {
+      return nullptr;
+    }
+    names[i] = {name, static_cast<std::size_t>(size)};
+  }
+
+  std::vector<std::pair<std::string, std::vector<std::byte>>> files;
+  try {
+    GilRelease nogil;
+    files = Zamboni::Group::ExtractNamed(AsSpan(*data), header, options, names);
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  auto list = PythonRef(PyList_New(std::ssize(files)));
+  if (!list) {
+    return nullptr;
+  }
+
+  for (std::size_t i = 0; i < files.size(); i++) {
+    const auto& [name, fileData] = files[i];
+
+    // "y#" would turn the null data of an empty file into None
+    PyObject* bytes = PyBytes_FromStringAndSize(reinterpret_cast<const char*>(fileData.data()), std::ssize(fileData));
+    if (!bytes) {
+      return nullptr;
+    }
+
+    PyObject* item = Py_BuildValue("(s#N)", name.data(), std::ssize(name), bytes);
+    if (!item) {
+      return nullptr;
+    }
+    PyList_SET_ITEM(*list, i, item);
+  }
+
+  return Py_NewRef(*list);
+}
+
+PyObject* SplitGroup(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char FileCountArg[] = "file_count";
+  static char* kwlist[] = {DataArg, FileCountArg, nullptr};
+
+  PythonBuffer data;
+  Zamboni::Group::GroupHeader header;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*I", kwlist, &data, &header.fileCount)) {
+    return nullptr;
+  }
+
+  std::vector<Zamboni::Group::FileEntry> files;
+  try {
+    GilRelease nogil;
+    files = Zamboni::Group::Split(header, AsSpan(*data));
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  auto list = PythonRef(PyList_New(std::ssize(files)));
+  if (!list) {
+    return nullptr;
+  }
+
+  for (std::size_t i = 0; i < files.size(); i++) {
+    const auto& file = files[i];
+    PyObject* item = Py_BuildValue("(s#nn)", file.name.data(), std::ssize(file.name),
+                                   static_cast<Py_ssize_t>(file.offset), static_cast<Py_ssize_t>(file.size));
+    if (!item) {
+      return nullptr;
+    }
+    PyList_SET_ITEM(*list, i, item);
+  }
+
+  return Py_NewRef(*list);
+}
+
+PyObject* CombineGroup(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char FilesArg[] = "files";
+  static char* kwlist[] = {FilesArg, nullptr};
+
+  PyObject* filesArg;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", kwlist, &filesArg)) {
+    return nullptr;
+  }
+
+  auto sequence = PythonRef(PySequence_Fast(filesArg, "Expected a sequence of (name, data) pairs"));
+  if (!sequence) {
+    return nullptr;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  std::vector<PythonBuffer> buffers(count);
+  std::vector<Zamboni::Group::FileData> files(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    const char* name;
+    Py_ssize_t nameSize;
+
+    // The name stays valid as long as the sequence holds the str
+    if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(*sequence, i), "s#y*", &name, &nameSize, &buffers[i])) {
+      return nullptr;
+    }
+
+    files[i] = {.name = {name, static_cast<std::size_t>(nameSize)}, .data = AsSpan(*buffers[i])};
+  }
+
+  const auto size = Zamboni::Group::CombinedSize(files);
+
+  auto result = PythonRef(PyBytes_FromStringAndSize(nullptr, static_cast<Py_ssize_t>(size)));
+  if (!result) {
+    return nullptr;
+  }
+
+  try {
+    GilRelease nogil;
+    Zamboni::Group::Combine(files, BytesAsSpan(*result));
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  return Py_NewRef(*result);
+}
+
+PyObject* CompressGroups(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char GroupsArg[] = "groups";
+  static char ModeArg[] = "mode";
+  static char LevelArg[] = "level";
+  static char ThreadsArg[] = "threads";
+  static char* kwlist[] = {GroupsArg, ModeArg, LevelArg, ThreadsArg, nullptr};
+
+  PyObject* groupsArg;
+  const char* mode = "kraken";
+  Zamboni::Group::CompressOptions options;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|sii", kwlist, &groupsArg, &mode, &options.level,
+                                   &options.threads)) {
+    return nullptr;
+  }
+
+  if (const auto compression = ParseCompression(mode)) {
+    options.compression = *compression;
+  } else {
+    PyErr_Format(PyExc_ValueError, "Unknown compression mode '%s'", mode);
+    return nullptr;
+  }
+
+  auto sequence = PythonRef(PySequence_Fast(groupsArg, "Expected a sequence of buffers"));
+  if (!sequence) {
+    return nullptr;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  std::vector<PythonBuffer> buffers(count);
+  std::vector<std::span<const std::byte>> groups(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(*sequence, i), &buffers[i], PyBUF_CONTIG_RO) != 0) {
+      return nullptr;
+    }
+    groups[i] = AsSpan(*buffers[i]);
+  }
+
+  std::vector<std::vector<std::byte>> compressed;
+  try {
+    GilRelease nogil;
+    compressed = Zamboni::Group::Compress(groups, options);
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  auto result = PythonRef(PyList_New(count));
+  if (!result) {
+    return nullptr;
+  }
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    const auto& data = compressed[i];
+    PyObject* item = PyBytes_FromStringAndSize(reinterpret_cast<const char*>(data.data()), std::ssize(data));
+    if (!item) {
+      return nullptr;
+    }
+    PyList_SET_ITEM(*result, i, item);
+  }
+
+  return Py_NewRef(*result);
+}
+
+// Convert a sequence of (name, path) pairs to files to pack
+bool ToPackFiles(PyObject* obj, std::vector<Zamboni::Ice::PackFile>& files) {
+  auto sequence = PythonRef(PySequence_Fast(obj, "Expected a sequence of (name, path) pairs"));
+  if (!sequence) {
+    return false;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  files.resize(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    const char* name;
+    Py_ssize_t nameSize;
+    PyObject* path;
+
+    if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(*sequence, i), "s#O", &name, &nameSize, &path) ||
+        !ToPath(path, files[i].path)) {
+      return false;
+    }
+    files[i].name = {name, static_cast<std::size_t>(nameSize)};
+  }
+
+  return true;
+}
+
+PyObject* WriteV4(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char PathArg[] = "path";
+  static char Group1Arg[] = "group1";
+  static char Group2Arg[] = "group2";
+  static char ModeArg[] = "mode";
+  static char LevelArg[] = "level";
+  static char ThreadsArg[] = "threads";
+  static char* kwlist[] = {PathArg, Group1Arg, Group2Arg, ModeArg, LevelArg, ThreadsArg, nullptr};
+
+  PyObject* pathArg;
+  PyObject* group1Arg;
+  PyObject* group2Arg;
+  const char* mode = "kraken";
+  Zamboni::Group::CompressOptions options;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|sii", kwlist, &pathArg, &group1Arg, &group2Arg, &mode,
+                                   &options.level, &options.threads)) {
+    return nullptr;
+  }
+
+  if (const auto compression = ParseCompression(mode)) {
+    options.compression = *compression;
+  } else {
+    PyErr_Format(PyExc_ValueError, "Unknown compression mode '%s'", mode);
+    return nullptr;
+  }
+
+  std::filesystem::path path;
+  std::vector<Zamboni::Ice::PackFile> group1;
+  std::vector<Zamboni::Ice::PackFile> group2;
+
+  if (!ToPath(pathArg, path) || !ToPackFiles(group1Arg, group1) || !ToPackFiles(group2Arg, group2)) {
+    return nullptr;
+  }
+
+  try {
+    GilRelease nogil;
+    Zamboni::Ice::WriteV4(path, {group1, group2}, options);
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_OSError, ex.what());
+    return nullptr;
+  }
+
+  Py_RETURN_NONE;
+}
+
+PyObject* UnpackMany(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char JobsArg[] = "jobs";
+  static char UseGroupsArg[] = "use_groups";
+  static char DumpRawDataArg[] = "dump_raw_data";
+  static char ThreadsArg[] = "threads";
+  static char IoThreadsArg[] = "io_threads";
+  static char QueueSizeArg[] = "queue_size";
+  static char* kwlist[] = {JobsArg, UseGroupsArg, DumpRawDataArg, ThreadsArg, IoThreadsArg, QueueSizeArg, nullptr};
+
+  PyObject* jobsArg;
+  int useGroups = 0;
+  int dumpRawData = 0;
+  int threads = 0;
+  int ioThreads = 0;
+  Py_ssize_t queueSize = Zamboni::Batch::UnpackOptions{}.queueSize;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|ppiin", kwlist, &jobsArg, &useGroups, &dumpRawData, &threads,
+                                   &ioThreads, &queueSize)) {
+    return nullptr;
+  }
+
+  if (ioThreads < 0 || queueSize < 0) {
+    PyErr_SetString(PyExc_ValueError, "io_threads and queue_size must not be negative");
+    return nullptr;
+  }
+
+  auto sequence = PythonRef(PySequence_Fast(jobsArg, "Expected a sequence of (archive, out_dir) pairs"));
+  if (!sequence) {
+    return nullptr;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  std::vector<Zamboni::Batch::UnpackJob> jobs(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    PyObject* input;
+    PyObject* outDir;
+    if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(*sequence, i), "OO", &input, &outDir) ||
+        !ToPath(input, jobs[i].input) || !ToPath(outDir, jobs[i].outDir)) {
+      return nullptr;
+    }
+  }
+
+  const Zamboni::Batch::UnpackOptions options{
+      .useGroups = useGroups != 0,
+      .dumpRawData = dumpRawData != 0,
+      .ioThreads = ioThreads,
+      .queueSize = static_cast<std::size_t>(queueSize),
+  };
+
+  std::vector<Zamboni::Batch::UnpackResult> results;
+  try {
+    GilRelease nogil;
+    results = Zamboni::Batch::UnpackMany(jobs, options, threads);
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  auto list = PythonRef(PyList_New(count));
+  if (!list) {
+    return nullptr;
+  }
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    const auto& result = results[i];
+
+    auto files = PythonRef(PyList_New(std::ssize(result.files)));
+    if (!files) {
+      return nullptr;
+    }
+    for (std::size_t j = 0; j < result.files.size(); j++) {
+      PyObject* path = FromPath(result.files[j]);
+      if (!path) {
+        return nullptr;
+      }
+      PyList_SET_ITEM(*files, j, path);
+    }
+
+    auto stats = PythonRef(ArchiveStats(result.stats));
+    if (!stats) {
+      return nullptr;
+    }
+
+    PyObject* item;
+    if (result.error.empty()) {
+      item = Py_BuildValue("(OOO)", *files, Py_None, *stats);
+    } else {
+      auto error = PythonRef(PyUnicode_DecodeUTF8(result.error.data(), std::ssize(result.error), "replace"));
+      if (!error) {
+        return nullptr;
+      }
+      item = Py_BuildValue("(OOO)", *files, *error, *stats);
+    }
+
+    if (!item) {
+      return nullptr;
+    }
+    PyList_SET_ITEM(*list, i, item);
+  }
+
+  return Py_NewRef(*list);
+}
+
+PyObject* VerifyMany(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char PathsArg[] = "paths";
+  static char ThreadsArg[] = "threads";
+  static char* kwlist[] = {PathsArg, ThreadsArg, nullptr};
+
+  PyObject* pathsArg;
+  int threads = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwlist, &pathsArg, &threads)) {
+    return nullptr;
+  }
+
+  auto sequence = PythonRef(PySequence_Fast(pathsArg, "Expected a sequence of paths"));
+  if (!sequence) {
+    return nullptr;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  std::vector<std::filesystem::path> paths(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    if (!ToPath(PySequence_Fast_GET_ITEM(*sequence, i), paths[i])) {
+      return nullptr;
+    }
+  }
+
+  std::vector<Zamboni::Batch::VerifyResult> results;
+  try {
+    GilRelease nogil;
+    results = Zamboni::Batch::VerifyMany(paths, threads);
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  auto list = PythonRef(PyList_New(count));
+  if (!list) {
+    return nullptr;
+  }
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    const auto& errors = results[i].errors;
+
+    auto errorList = PythonRef(PyList_New(std::ssize(errors)));
+    if (!errorList) {
+      return nullptr;
+    }
+    for (std::size_t j = 0; j < errors.size(); j++) {
+      PyObject* error = PyUnicode_DecodeUTF8(errors[j].data(), std::ssize(errors[j]), "replace");
+      if (!error) {
+        return nullptr;
+      }
+      PyList_SET_ITEM(*errorList, j, error);
+    }
+
+    auto stats = PythonRef(ArchiveStats(results[i].stats));
+    if (!stats) {
+      return nullptr;
+    }
+
+    PyObject* item = Py_BuildValue("(OO)", *errorList, *stats);
+    if (!item) {
+      return nullptr;
+    }
+    PyList_SET_ITEM(*list, i, item);
+  }
+
+  return Py_NewRef(*list);
+}
+
+PyObject* IndexMany(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char PathsArg[] = "paths";
+  static char ThreadsArg[] = "threads";
+  static char* kwlist[] = {PathsArg, ThreadsArg, nullptr};
+
+  PyObject* pathsArg;
+  int threads = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i", kwlist, &pathsArg, &threads)) {
+    return nullptr;
+  }
+
+  auto sequence = PythonRef(PySequence_Fast(pathsArg, "Expected a sequence of paths"));
+  if (!sequence) {
+    return nullptr;
+  }
+
+  const auto count = PySequence_Fast_GET_SIZE(*sequence);
+  std::vector<std::filesystem::path> paths(count);
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    if (!ToPath(PySequence_Fast_GET_ITEM(*sequence, i), paths[i])) {
+      return nullptr;
+    }
+  }
+
+  std::vector<Zamboni::Batch::IndexResult> results;
+  try {
+    GilRelease nogil;
+    results = Zamboni::Batch::IndexMany(paths, threads);
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+
+  auto list = PythonRef(PyList_New(count));
+  if (!list) {
+    return nullptr;
+  }
+
+  for (Py_ssize_t i = 0; i < count; i++) {
+    const auto& result = results[i];
+
+    auto files = PythonRef(PyList_New(std::ssize(result.files)));
+    if (!files) {
+      return nullptr;
+    }
+    for (std::size_t j = 0; j < result.files.size(); j++) {
+      const auto& file = result.files[j];
+
+      // A bad name in one archive should not stop the others from being indexed
+      PyObject* name = PyUnicode_DecodeUTF8(file.name.data(), std::ssize(file.name), "replace");
+      if (!name) {
+        return nullptr;
+      }
+
+      PyObject* item = Py_BuildValue("(nNnnI)", static_cast<Py_ssize_t>(file.group), name,
+                                     static_cast<Py_ssize_t>(file.offset), static_cast<Py_ssize_t>(file.size),
+                                     file.crc32);
+      if (!item) {
+        return nullptr;
+      }
+      PyList_SET_ITEM(*files, j, item);
+    }
+
+    PyObject* item;
+    if (result.error.empty()) {
+      item = Py_BuildValue("(IIOO)", result.version, result.flags, *files, Py_None);
+    } else {
+      auto error = PythonRef(PyUnicode_DecodeUTF8(result.error.data(), std::ssize(result.error), "replace"));
+      if (!error) {
+        return nullptr;
+      }
+      item = Py_BuildValue("(IIOO)", result.version, result.flags, *files, *error);
+    }
+
+    if (!item) {
+      return nullptr;
+    }
+    PyList_SET_ITEM(*list, i, item);
+  }
+
+  return Py_NewRef(*list);
+}
+
+PyMethodDef Methods[] = {
+    {"extract_group", (PyCFunction)(void (*)(void))ExtractGroup, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"extract_files", (PyCFunction)(void (*)(void))ExtractFiles, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"split_group", (PyCFunction)(void (*)(void))SplitGroup, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"combine_group", (PyCFunction)(void (*)(void))CombineGroup, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"compress_groups", (PyCFunction)(void (*)(void))CompressGroups, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"write_v4", (PyCFunction)(void (*)(void))WriteV4, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"unpack_many", (PyCFunction)(void (*)(void))UnpackMany, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"verify_many", (PyCFunction)(void (*)(void))VerifyMany, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"index_many", (PyCFunction)(void (*)(void))IndexMany, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"_stats", GetStats, METH_NOARGS, nullptr},
+    {"_set_stats_enabled", SetStatsEnabled, METH_VARARGS, nullptr},
+    {"_reset_stats", ResetStats, METH_NOARGS, nullptr},
+    {},  // Sentinel
+};
+
+PyModuleDef Module = {
+    .m_base = PyModuleDef_HEAD_INIT,
+    .m_name = "native",
+    .m_size = -1,
+    .m_methods = Methods,
+};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit_native() { return PyModule_Create(&Module); }
\ No newline at end of file
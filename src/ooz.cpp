@@ -1,11 +1,12 @@
-#define PY_SSIZE_T_CLEAN
-
-#include <Python.h>
 #include <ooz.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <vector>
 
+#include "stats.hpp"
+#include "util.hpp"
+
 namespace {
 
 PyObject* KrakenCompress(PyObject* self, PyObject* args, PyObject* kwargs) {
@@ -13,19 +14,24 @@ PyObject* KrakenCompress(PyObject* self, PyObject* args, PyObject* kwargs) {
   static char LevelArg[] = "level";
   static char* kwlist[] = {DataArg, LevelArg, nullptr};
 
-  Py_buffer data;
+  PythonBuffer data;
   int level = 4;
 
   if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|i", kwlist, &data, &level)) {
     return nullptr;
   }
 
-  std::vector<uint8_t> output(data.len + 0x10000);
-  const auto size =
-      Kraken_Compress(static_cast<uint8_t*>(data.buf), static_cast<size_t>(data.len), output.data(), level);
+  const auto input = AsSpan<uint8_t>(*data);
+  std::vector<uint8_t> output(input.size() + 0x10000);
+  int size;
+  {
+    GilRelease nogil;
+    const Zamboni::Stats::Timer timer{Zamboni::Stats::Stage::KrakenCompress, input.size()};
+    size = Kraken_Compress(input.data(), input.size(), output.data(), level);
+  }
 
   if (size < 0) {
-    PyErr_SetString(PyExc_ValueError, "Failed to decompress");
+    PyErr_SetString(PyExc_ValueError, "Failed to compress");
     return nullptr;
   }
 
@@ -33,28 +39,171 @@ PyObject* KrakenCompress(PyObject* self, PyObject* args, PyObject* kwargs) {
 }
 
 PyObject* KrakenDecompress(PyObject* self, PyObject* args) {
-  const uint8_t* data;
-  Py_ssize_t dataSize;
+  PythonBuffer data;
   Py_ssize_t outSize;
 
-  if (!PyArg_ParseTuple(args, "y#n", &data, &dataSize, &outSize)) {
+  if (!PyArg_ParseTuple(args, "y*n", &data, &outSize)) {
+    return nullptr;
+  }
+
+  if (outSize < 0) {
+    PyErr_SetString(PyExc_ValueError, "out_size must not be negative");
     return nullptr;
   }
 
-  std::vector<uint8_t> output(outSize + SAFE_SPACE);
-  const auto size = Kraken_Decompress(data, static_cast<size_t>(dataSize), output.data(), static_cast<size_t>(outSize));
+  // The decompressor may write past the end of the output, so allocate extra space and trim it afterwards
+  PyObject* result = PyBytes_FromStringAndSize(nullptr, outSize + SAFE_SPACE);
+  if (!result) {
+    return nullptr;
+  }
+
+  int size;
+  {
+    GilRelease nogil;
+    const Zamboni::Stats::Timer timer{Zamboni::Stats::Stage::KrakenDecompress, static_cast<std::size_t>(outSize)};
+    const auto input = AsSpan<const uint8_t>(*data);
+    size = Kraken_Decompress(input.data(), input.size(), BytesAsSpan<uint8_t>(result).data(),
+                             static_cast<size_t>(outSize));
+  }
 
   if (size < 0) {
+    Py_DECREF(result);
     PyErr_SetString(PyExc_ValueError, "Failed to decompress");
     return nullptr;
   }
 
+  if (_PyBytes_Resize(&result, size) < 0) {
+    return nullptr;
+  }
+
+  return result;
+}
+
+PyObject* KrakenDecompressInto(PyObject* self, PyObject* args) {
+  PythonBuffer data;
+  PythonBuffer out;
+  Py_ssize_t outSize;
+
+  if (!PyArg_ParseTuple(args, "y*w*n", &data, &out, &outSize)) {
+    return nullptr;
+  }
+
+  if (outSize < 0 || (*out).len < outSize + SAFE_SPACE) {
+    PyErr_Format(PyExc_ValueError, "Output buffer must be at least out_size + SAFE_SPACE (%zd) bytes",
+                 outSize + SAFE_SPACE);
+    return nullptr;
+  }
+
+  int size;
+  {
+    GilRelease nogil;
+    const Zamboni::Stats::Timer timer{Zamboni::Stats::Stage::KrakenDecompress, static_cast<std::size_t>(outSize)};
+    const auto input = AsSpan<const uint8_t>(*data);
+    size = Kraken_Decompress(input.data(), input.size(), AsSpan<uint8_t>(*out).data(), static_cast<size_t>(outSize));
+  }
+
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "Failed to decompress");
+    return nullptr;
+  }
+
+  return PyLong_FromLong(size);
+}
+
+// Kraken allocates its own match finder tables on every call, so only the output buffer is kept between calls
+struct KrakenCompressorObject {
+  PyObject_HEAD
+  std::vector<uint8_t>* output;
+  int level;
+  // Set while compress() runs without the GIL, so another thread can't use the same compressor
+  bool busy;
+};
+
+int KrakenCompressorInit(KrakenCompressorObject* self, PyObject* args, PyObject* kwargs) {
+  static char LevelArg[] = "level";
+  static char* kwlist[] = {LevelArg, nullptr};
+
+  int level = 4;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", kwlist, &level)) {
+    return -1;
+  }
+
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "Compressor is in use");
+    return -1;
+  }
+
+  if (!self->output) {
+    self->output = new std::vector<uint8_t>{};
+  }
+  self->level = level;
+  return 0;
+}
+
+void KrakenCompressorDealloc(KrakenCompressorObject* self) {
+  delete self->output;
+  Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+PyObject* KrakenCompressorCompress(KrakenCompressorObject* self, PyObject* args) {
+  PythonBuffer data;
+
+  if (!PyArg_ParseTuple(args, "y*", &data)) {
+    return nullptr;
+  }
+
+  if (!self->output) {
+    PyErr_SetString(PyExc_RuntimeError, "Compressor is not initialized");
+    return nullptr;
+  }
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "Compressor is in use by another thread");
+    return nullptr;
+  }
+
+  const auto input = AsSpan<uint8_t>(*data);
+  auto& output = *self->output;
+  int size;
+  {
+    BusyFlag busy{self->busy};
+    GilRelease nogil;
+    output.resize(std::max(output.size(), input.size() + 0x10000));
+    const Zamboni::Stats::Timer timer{Zamboni::Stats::Stage::KrakenCompress, input.size()};
+    size = Kraken_Compress(input.data(), input.size(), output.data(), self->level);
+  }
+
+  if (size < 0) {
+    PyErr_SetString(PyExc_ValueError, "Failed to compress");
+    return nullptr;
+  }
+
   return Py_BuildValue("y#", output.data(), size);
 }
 
+PyMethodDef KrakenCompressorMethods[] = {
+    {"compress", (PyCFunction)KrakenCompressorCompress, METH_VARARGS, nullptr},
+    {},  // Sentinel
+};
+
+PyTypeObject KrakenCompressorType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "zamboni.ooz.KrakenCompressor",
+    .tp_basicsize = sizeof(KrakenCompressorObject),
+    .tp_dealloc = (destructor)KrakenCompressorDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_methods = KrakenCompressorMethods,
+    .tp_init = (initproc)KrakenCompressorInit,
+    .tp_new = PyType_GenericNew,
+};
+
 PyMethodDef Methods[] = {
-    {"kraken_compress", (PyCFunction)KrakenCompress, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"kraken_compress", (PyCFunction)(void (*)(void))KrakenCompress, METH_VARARGS | METH_KEYWORDS, nullptr},
     {"kraken_decompress", KrakenDecompress, METH_VARARGS, nullptr},
+    {"kraken_decompress_into", KrakenDecompressInto, METH_VARARGS, nullptr},
+    {"_stats", GetStats, METH_NOARGS, nullptr},
+    {"_set_stats_enabled", SetStatsEnabled, METH_VARARGS, nullptr},
+    {"_reset_stats", ResetStats, METH_NOARGS, nullptr},
     {},  // Sentinel
 };
 
@@ -67,4 +216,18 @@ PyModuleDef Module = {
 
 }  // namespace
 
-PyMODINIT_FUNC PyInit_ooz() { return PyModule_Create(&Module); }
\ No newline at end of file
+PyMODINIT_FUNC PyInit_ooz() {
+  if (PyType_Ready(&KrakenCompressorType) < 0) {
+    return nullptr;
+  }
+
+  PyObject* module = PyModule_Create(&Module);
+  if (module && (PyModule_AddIntConstant(module, "SAFE_SPACE", SAFE_SPACE) < 0 ||
+                 PyModule_AddObjectRef(module, "KrakenCompressor", reinterpret_cast<PyObject*>(&KrakenCompressorType)) <
+                     0)) {
+    Py_DECREF(module);
+    return nullptr;
+  }
+
+  return module;
+}
\ No newline at end of file
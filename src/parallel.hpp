@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Zamboni {
+
+// Number of worker threads to use when the caller asks for 0 (automatic)
+inline int DefaultThreadCount() { return static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); }
+
+// Call fn(i) for each i in [0, count) on up to `threads` threads, including the calling thread. If threads is 0, uses
+// DefaultThreadCount(). Items are handed out in order, so put the most expensive items first. If any call throws, the
+// remaining items are skipped and the first exception is rethrown once all threads have finished.
+template <class Func>
+void ParallelFor(std::size_t count, int threads, Func&& fn) {
+  if (threads <= 0) {
+    threads = DefaultThreadCount();
+  }
+
+  const auto workerCount = std::min(static_cast<std::size_t>(threads), count);
+  if (workerCount <= 1) {
+    for (std::size_t i = 0; i < count; i++) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> next{0};
+  std::exception_ptr error{};
+  std::mutex errorMutex{};
+
+  auto work = [&] {
+    for (auto i = next++; i < count; i = next++) {
+      try {
+        fn(i);
+      } catch (...) {
+        const std::lock_guard lock{errorMutex};
+        if (!error) {
+          error = std::current_exception();
+        }
+        next = count;
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers{};
+    workers.reserve(workerCount - 1);
+    for (std::size_t i = 1; i < workerCount; i++) {
+      workers.emplace_back(work);
+    }
+
+    work();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+}  // namespace Zamboni
\ No newline at end of file
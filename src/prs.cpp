@@ -1,55 +1,264 @@
-#define PY_SSIZE_T_CLEAN
-
 #include "prs.hpp"
 
-#include <Python.h>
-
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <new>
+#include <span>
 #include <stdexcept>
+#include <vector>
+
+#include "util.hpp"
 
 namespace {
 
-PyObject* PrsCompress(PyObject* self, PyObject* args) {
-  const std::byte* data;
-  Py_ssize_t dataSize;
+PyObject* PrsCompress(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char LevelArg[] = "level";
+  static char SearchDepthArg[] = "search_depth";
+  static char XorKeyArg[] = "xor_key";
+  static char DictionaryArg[] = "dictionary";
+  static char* kwlist[] = {DataArg, LevelArg, SearchDepthArg, XorKeyArg, DictionaryArg, nullptr};
 
-  if (!PyArg_ParseTuple(args, "y#", &data, &dataSize)) {
+  PythonBuffer data;
+  int level = Zamboni::Prs::DefaultLevel;
+  int searchDepth = 0;
+  unsigned char xorKey = 0;
+  PythonBuffer dictionary;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|iiby*", kwlist, &data, &level, &searchDepth, &xorKey,
+                                   &dictionary)) {
     return nullptr;
   }
 
   try {
-    const auto result = Zamboni::Prs::Compress({data, static_cast<std::size_t>(dataSize)});
+    auto options = Zamboni::Prs::CompressOptions::FromLevel(level);
+    if (searchDepth) {
+      options.searchDepth = searchDepth;
+    }
+    options.xorKey = std::byte{xorKey};
+
+    std::vector<std::byte> result;
+    {
+      GilRelease nogil;
+      result = Zamboni::Prs::Compress(AsSpan(*data), options, AsSpan(*dictionary));
+    }
 
     return Py_BuildValue("y#", result.data(), result.size());
   } catch (const std::out_of_range& ex) {
     PyErr_SetString(PyExc_ValueError, ex.what());
     return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
   }
 }
 
-PyObject* PrsDecompress(PyObject* self, PyObject* args) {
-  const std::byte* data;
-  Py_ssize_t dataSize;
+PyObject* PrsDecompress(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char OutSizeArg[] = "out_size";
+  static char XorKeyArg[] = "xor_key";
+  static char DictionaryArg[] = "dictionary";
+  static char* kwlist[] = {DataArg, OutSizeArg, XorKeyArg, DictionaryArg, nullptr};
+
+  PythonBuffer data;
   Py_ssize_t outSize;
+  unsigned char xorKey = 0;
+  PythonBuffer dictionary;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*n|by*", kwlist, &data, &outSize, &xorKey, &dictionary)) {
+    return nullptr;
+  }
+
+  if (outSize < 0) {
+    PyErr_SetString(PyExc_ValueError, "out_size must not be negative");
+    return nullptr;
+  }
+
+  auto result = PythonRef(PyBytes_FromStringAndSize(nullptr, outSize));
+  if (!result) {
+    return nullptr;
+  }
+
+  try {
+    const auto output = BytesAsSpan(*result);
+    {
+      GilRelease nogil;
+      const auto size = Zamboni::Prs::Decompress(AsSpan(*data), output, std::byte{xorKey}, AsSpan(*dictionary));
+      std::fill(output.begin() + size, output.end(), std::byte{0});
+    }
+
+    return Py_NewRef(*result);
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+}
+
+PyObject* PrsDecompressInto(PyObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char OutArg[] = "out";
+  static char XorKeyArg[] = "xor_key";
+  static char DictionaryArg[] = "dictionary";
+  static char* kwlist[] = {DataArg, OutArg, XorKeyArg, DictionaryArg, nullptr};
+
+  PythonBuffer data;
+  PythonBuffer out;
+  unsigned char xorKey = 0;
+  PythonBuffer dictionary;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*w*|by*", kwlist, &data, &out, &xorKey, &dictionary)) {
+    return nullptr;
+  }
+
+  try {
+    std::ptrdiff_t size;
+    {
+      GilRelease nogil;
+      size = Zamboni::Prs::Decompress(AsSpan(*data), AsSpan(*out), std::byte{xorKey}, AsSpan(*dictionary));
+    }
+
+    return PyLong_FromSsize_t(size);
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
+  }
+}
+
+struct CompressorObject {
+  PyObject_HEAD
+  Zamboni::Prs::Compressor* compressor;
+  // Set while compress() runs without the GIL, so another thread can't use the same compressor
+  bool busy;
+};
+
+int CompressorInit(CompressorObject* self, PyObject* args, PyObject* kwargs) {
+  static char LevelArg[] = "level";
+  static char SearchDepthArg[] = "search_depth";
+  static char XorKeyArg[] = "xor_key";
+  static char* kwlist[] = {LevelArg, SearchDepthArg, XorKeyArg, nullptr};
+
+  int level = Zamboni::Prs::DefaultLevel;
+  int searchDepth = 0;
+  unsigned char xorKey = 0;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|iib", kwlist, &level, &searchDepth, &xorKey)) {
+    return -1;
+  }
+
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "Compressor is in use");
+    return -1;
+  }
+
+  try {
+    auto options = Zamboni::Prs::CompressOptions::FromLevel(level);
+    if (searchDepth) {
+      options.searchDepth = searchDepth;
+    }
+    options.xorKey = std::byte{xorKey};
 
-  if (!PyArg_ParseTuple(args, "y#n", &data, &dataSize, &outSize)) {
+    auto compressor = new Zamboni::Prs::Compressor{options};
+    delete self->compressor;
+    self->compressor = compressor;
+    return 0;
+  } catch (const std::out_of_range& ex) {
+    PyErr_SetString(PyExc_ValueError, ex.what());
+    return -1;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return -1;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return -1;
+  }
+}
+
+void CompressorDealloc(CompressorObject* self) {
+  delete self->compressor;
+  Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+PyObject* CompressorCompress(CompressorObject* self, PyObject* args, PyObject* kwargs) {
+  static char DataArg[] = "data";
+  static char DictionaryArg[] = "dictionary";
+  static char* kwlist[] = {DataArg, DictionaryArg, nullptr};
+
+  PythonBuffer data;
+  PythonBuffer dictionary;
+
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "y*|y*", kwlist, &data, &dictionary)) {
+    return nullptr;
+  }
+
+  if (!self->compressor) {
+    PyErr_SetString(PyExc_RuntimeError, "Compressor is not initialized");
+    return nullptr;
+  }
+  if (self->busy) {
+    PyErr_SetString(PyExc_RuntimeError, "Compressor is in use by another thread");
     return nullptr;
   }
 
   try {
-    const auto result = Zamboni::Prs::Decompress({data, static_cast<std::size_t>(dataSize)}, outSize);
+    std::span<const std::byte> result;
+    {
+      BusyFlag busy{self->busy};
+      GilRelease nogil;
+      result = self->compressor->Compress(AsSpan(*data), AsSpan(*dictionary));
+    }
 
     return Py_BuildValue("y#", result.data(), result.size());
   } catch (const std::out_of_range& ex) {
     PyErr_SetString(PyExc_ValueError, ex.what());
     return nullptr;
+  } catch (const std::bad_alloc&) {
+    PyErr_NoMemory();
+    return nullptr;
+  } catch (const std::exception& ex) {
+    PyErr_SetString(PyExc_RuntimeError, ex.what());
+    return nullptr;
   }
 }
 
+PyMethodDef CompressorMethods[] = {
+    {"compress", (PyCFunction)(void (*)(void))CompressorCompress, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {},  // Sentinel
+};
+
+PyTypeObject CompressorType = {
+    .ob_base = PyVarObject_HEAD_INIT(nullptr, 0)
+    .tp_name = "zamboni.prs.Compressor",
+    .tp_basicsize = sizeof(CompressorObject),
+    .tp_dealloc = (destructor)CompressorDealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_methods = CompressorMethods,
+    .tp_init = (initproc)CompressorInit,
+    .tp_new = PyType_GenericNew,
+};
+
 PyMethodDef Methods[] = {
-    {"compress", PrsCompress, METH_VARARGS, nullptr},
-    {"decompress", PrsDecompress, METH_VARARGS, nullptr},
+    {"compress", (PyCFunction)(void (*)(void))PrsCompress, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"decompress", (PyCFunction)(void (*)(void))PrsDecompress, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"decompress_into", (PyCFunction)(void (*)(void))PrsDecompressInto, METH_VARARGS | METH_KEYWORDS, nullptr},
+    {"_stats", GetStats, METH_NOARGS, nullptr},
+    {"_set_stats_enabled", SetStatsEnabled, METH_VARARGS, nullptr},
+    {"_reset_stats", ResetStats, METH_NOARGS, nullptr},
     {},  // Sentinel
 };
 
@@ -62,4 +271,21 @@ PyModuleDef Module = {
 
 }  // namespace
 
-PyMODINIT_FUNC PyInit_prs() { return PyModule_Create(&Module); }
\ No newline at end of file
+PyMODINIT_FUNC PyInit_prs() {
+  if (PyType_Ready(&CompressorType) < 0) {
+    return nullptr;
+  }
+
+  auto module = PyModule_Create(&Module);
+  if (!module) {
+    return nullptr;
+  }
+
+  if (PyModule_AddObjectRef(module, "Compressor", reinterpret_cast<PyObject*>(&CompressorType)) < 0 ||
+      PyModule_AddIntConstant(module, "MAX_DICTIONARY_SIZE", Zamboni::Prs::MaxDictionarySize) < 0) {
+    Py_DECREF(module);
+    return nullptr;
+  }
+
+  return module;
+}
\ No newline at end of file
@@ -1,14 +1,102 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
 #include <span>
 #include <vector>
 
 namespace Zamboni {
 namespace Prs {
 
-std::vector<std::byte> Compress(std::span<const std::byte> inputBuffer);
-std::vector<std::byte> Decompress(std::span<const std::byte> inputBuffer, std::ptrdiff_t outSize);
+constexpr int DefaultLevel = 3;
+
+enum class Parser {
+  // Take the longest match at each position
+  Greedy,
+  // Defer a match by one byte when the next position has a better one
+  Lazy,
+  // Choose the cheapest sequence of literals and references
+  Optimal,
+};
+
+struct CompressOptions {
+  Parser parser = Parser::Lazy;
+  // Number of earlier positions the match finder tries for each input position. Higher values find longer
+  // references at the cost of speed.
+  int searchDepth = 32;
+  // Every byte of the output is XORed with this value
+  std::byte xorKey{0};
+
+  // Get the options for a compression level from 0 (fastest) to 9 (smallest)
+  static CompressOptions FromLevel(int level);
+
+  bool operator==(const CompressOptions&) const = default;
+};
+
+// Only the end of a dictionary can be referenced, since references reach at most this far back
+constexpr std::ptrdiff_t MaxDictionarySize = 0x2000;
+
+// A dictionary primes the match window as if the input followed it, which helps small inputs that resemble it. The
+// output can then only be decompressed with the same dictionary.
+std::vector<std::byte> Compress(std::span<const std::byte> inputBuffer, const CompressOptions& options = {},
+                                std::span<const std::byte> dictionary = {});
+
+// Compresses many inputs with the same options, keeping the match finder tables and output buffer between calls so
+// that small inputs don't pay for allocating and clearing them. Not thread safe, so use one per thread.
+class Compressor {
+ public:
+  explicit Compressor(const CompressOptions& options = {});
+  ~Compressor();
+
+  Compressor(const Compressor&) = delete;
+  Compressor& operator=(const Compressor&) = delete;
+
+  const CompressOptions& Options() const { return mOptions; }
+
+  // Compress an input, optionally with a dictionary. The output is valid until the next call.
+  std::span<const std::byte> Compress(std::span<const std::byte> input, std::span<const std::byte> dictionary = {});
+
+ private:
+  struct State;
+
+  CompressOptions mOptions;
+  std::unique_ptr<State> mState;
+};
+
+// xorKey unmasks every byte of the input as it is read, for streams that were compressed with the same key.
+std::vector<std::byte> Decompress(std::span<const std::byte> inputBuffer, std::ptrdiff_t outSize,
+                                  std::byte xorKey = std::byte{0});
+
+// Decompress into an existing buffer. Returns the number of bytes decoded, which may be less than the size of the
+// buffer if the input ends first. In that case, the contents of the rest of the buffer are unspecified. A stream that
+// was compressed with a dictionary must be given the same one.
+std::ptrdiff_t Decompress(std::span<const std::byte> inputBuffer, std::span<std::byte> output,
+                          std::byte xorKey = std::byte{0}, std::span<const std::byte> dictionary = {});
+
+// Decompresses a stream one piece at a time, keeping only the output that later references can reach. The decoded data
+// is the same as Decompress() would produce, so it works on the same streams.
+class StreamDecompressor {
+ public:
+  // Most output Read() returns at once
+  static constexpr std::ptrdiff_t PieceSize = 0x40000;
+
+  // The input must outlive the decompressor
+  StreamDecompressor(std::span<const std::byte> input, std::ptrdiff_t outSize, std::byte xorKey = std::byte{0});
+  ~StreamDecompressor();
+
+  // Decode the next piece of output, which is valid until the next call. Returns an empty span once outSize bytes have
+  // been decoded or the input ends.
+  std::span<const std::byte> Read();
+
+ private:
+  class State;
+
+  std::unique_ptr<State> mState;
+  std::vector<std::byte> mWindow;
+  std::ptrdiff_t mIndex = 0;
+  std::ptrdiff_t mRemaining;
+  bool mEnded = false;
+};
 
 }  // namespace Prs
 }  // namespace Zamboni
@@ -1,15 +1,17 @@
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <format>
-#include <iterator>
+#include <limits>
 #include <span>
 #include <stdexcept>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 #include "prs.hpp"
+#include "stats.hpp"
 
 namespace Zamboni {
 namespace Prs {
@@ -21,177 +23,495 @@ constexpr auto MaxLongRefSize = 255 + 10;
 constexpr std::ptrdiff_t ShortRefOffsetLimit = 1 << 8;
 constexpr std::ptrdiff_t LongRefOffsetLimit = 1 << (16 - 3);
 
-using OffsetList = std::pair<std::vector<std::ptrdiff_t>, std::ptrdiff_t>;
-using OffsetDictionary = std::unordered_map<std::byte, OffsetList>;
+constexpr std::ptrdiff_t WindowSize = 0x1FF0;
+constexpr std::ptrdiff_t ChainSize = 1 << 13;
+constexpr std::size_t HashSize = 1 << 16;
 
-OffsetDictionary BuildOffsetDictionary(std::span<const std::byte> input) {
-  OffsetDictionary dictionary{};
+static_assert(ChainSize >= WindowSize);
 
-  for (std::ptrdiff_t i = 0; i < std::ssize(input); i++) {
-    const auto key = input[i];
-    dictionary[key].first.push_back(i);
+struct Match {
+  int size = 0;
+  std::ptrdiff_t distance = 0;
+};
+
+struct Candidates {
+  // Longest match in the window
+  Match longest;
+  // Longest match within short reference range
+  Match nearby;
+};
+
+// Hash chain tables, which can be reused for another input without clearing them. Positions are stored relative to a
+// base that moves past the end of each input, so entries left over from earlier inputs are always outside the window.
+struct MatchTables {
+  std::vector<std::ptrdiff_t> head = std::vector<std::ptrdiff_t>(HashSize, -1);
+  std::vector<std::ptrdiff_t> chain = std::vector<std::ptrdiff_t>(ChainSize, -1);
+  std::ptrdiff_t base = 0;
+};
+
+// Hash chains keyed by the next two bytes. Two bytes is the shortest reference PRS can encode, so the key is exact
+// and every candidate on a chain is known to match at least that far. The chain only needs to remember the last
+// window's worth of positions, so it is a ring buffer indexed by position.
+class MatchFinder {
+ public:
+  MatchFinder(std::span<const std::byte> input, int searchDepth, MatchTables& tables)
+      : mInput{input}, mSearchDepth{searchDepth}, mHead{tables.head}, mChain{tables.chain}, mBase{tables.base} {
+    tables.base += std::ssize(input);
   }
 
-  return dictionary;
-}
+  void Insert(std::ptrdiff_t offset) {
+    if (offset + 2 > std::ssize(mInput)) {
+      return;
+    }
+
+    auto& head = mHead[Key(offset)];
+    mChain[(mBase + offset) & (ChainSize - 1)] = head;
+    head = mBase + offset;
+  }
+
+  Candidates Find(std::ptrdiff_t offset) const {
+    const auto length = std::ssize(mInput);
+    if (offset + 2 > length) {
+      return {};
+    }
+
+    const auto maxSize = static_cast<int>(std::min<std::ptrdiff_t>(length - offset, MaxLongRefSize));
+    const auto minOffset = std::max<std::ptrdiff_t>(offset - WindowSize, 0);
 
-OffsetList& GetOffsetList(OffsetDictionary& dictionary, std::byte value, std::ptrdiff_t offset) {
-  auto& item = dictionary[value];
+    Candidates best{};
+    auto depth = mSearchDepth;
 
-  if (item.second < offset - 0x1FF0) {
-    auto index = item.second;
-    while (index < std::ssize(item.first) && item.first[index] < offset - 0x1FF0) {
-      index++;
+    for (auto candidate = mHead[Key(offset)] - mBase; candidate >= minOffset && depth > 0;
+         candidate = mChain[(mBase + candidate) & (ChainSize - 1)] - mBase, depth--) {
+      const auto distance = offset - candidate;
+      const auto size = 2 + MatchLength(candidate + 2, offset + 2, maxSize - 2);
+
+      // Candidates are visited nearest first, so ties keep the shorter distance.
+      if (distance < ShortRefOffsetLimit && size > best.nearby.size) {
+        best.nearby = {size, distance};
+      }
+
+      // Two byte matches are only worth encoding as short references.
+      if (size == 2 && distance >= ShortRefOffsetLimit) {
+        continue;
+      }
+
+      if (size > best.longest.size) {
+        best.longest = {size, distance};
+
+        if (size == maxSize) {
+          break;
+        }
+      }
     }
 
-    item.second = index;
+    return best;
   }
 
-  return item;
-}
+ private:
+  std::size_t Key(std::ptrdiff_t offset) const {
+    return std::to_integer<std::size_t>(mInput[offset]) | (std::to_integer<std::size_t>(mInput[offset + 1]) << 8);
+  }
+
+  int MatchLength(std::ptrdiff_t a, std::ptrdiff_t b, int maxSize) const {
+    auto size = 0;
+
+    while (size + 8 <= maxSize) {
+      std::uint64_t x;
+      std::uint64_t y;
+      std::memcpy(&x, &mInput[a + size], sizeof(x));
+      std::memcpy(&y, &mInput[b + size], sizeof(y));
+
+      if (const auto diff = x ^ y) {
+        if constexpr (std::endian::native == std::endian::little) {
+          return size + std::countr_zero(diff) / 8;
+        } else {
+          return size + std::countl_zero(diff) / 8;
+        }
+      }
+
+      size += 8;
+    }
 
+    while (size < maxSize && mInput[a + size] == mInput[b + size]) {
+      size++;
+    }
+
+    return size;
+  }
+
+  std::span<const std::byte> mInput;
+  int mSearchDepth;
+  std::vector<std::ptrdiff_t>& mHead;
+  std::vector<std::ptrdiff_t>& mChain;
+  std::ptrdiff_t mBase;
+};
+
+// Buffers used while compressing, which a Compressor keeps between inputs
+struct Workspace {
+  MatchTables tables;
+  // Only used by the optimal parser
+  std::vector<std::uint32_t> cost;
+  std::vector<Match> step;
+  std::vector<Match> path;
+  // The dictionary followed by the input, when compressing with a dictionary
+  std::vector<std::byte> primed;
+};
+
+// A literal takes 9 bits including its control bit, and every reference takes fewer bits per input byte, so the output
+// is at most 9/8 of the input plus the end marker and the last partial control byte
+constexpr std::size_t MaxCompressedSize(std::size_t size) { return size + size / 8 + 8; }
+
+// The parsers only produce references that fit these limits, so the encoder does not check them
+static_assert(WindowSize < LongRefOffsetLimit);
+static_assert(MaxLongRefSize - 10 <= 0xFF);
+
+// Writes tokens into an output buffer that is sized for the worst case up front. Control bits are gathered in a
+// register and stored once their byte is full. Like the reference encoder, the byte for the next control bits is
+// reserved at the current end of the output when the first of them is added, so the output is the same.
 class CompressState {
  public:
-  explicit CompressState(std::vector<std::byte>& output) : mBuffer{output}, mOut{std::back_inserter(output)} {}
+  CompressState(std::vector<std::byte>& output, std::size_t inputSize, std::byte xorKey)
+      : mBuffer{output}, mXorKey{xorKey} {
+    mBuffer.resize(MaxCompressedSize(inputSize));
+    mOut = mBuffer.data();
+  }
 
+  CompressState(const CompressState&) = delete;
+  CompressState& operator=(const CompressState&) = delete;
+
+  // The stream starts with a control byte whose first two bits are set for two literals
   void WriteStart(std::byte in0, std::byte in1) {
-    mOut = std::byte{3};
-    mOut = in0;
-    mOut = in1;
+    mControlByte = mOut++;
+    mControl = 0b11;
+    mControlCount = 2;
+    Put(in0);
+    Put(in1);
   }
 
+  // Ends the stream with a long reference of offset 0, then trims the buffer to the output
   void WriteEnd() {
-    AddControlBit(0);
-    AddControlBit(1);
-    mOut = std::byte{0};
-    mOut = std::byte{0};
+    AddControlBits<2>(0b10);
+    Put(std::byte{0});
+    Put(std::byte{0});
+    StoreControl();
+
+    mBuffer.resize(mOut - mBuffer.data());
   }
 
   void WriteByte(std::byte value) {
-    AddControlBit(1);
-    mOut = value;
+    AddControlBits<1>(1);
+    Put(value);
   }
 
+  // Sizes 2-5 and offsets up to 0xFF
   void WriteShortReference(int size, std::ptrdiff_t offset) {
-    if (size > MaxShortRefSize) {
-      throw std::out_of_range{std::format("Short reference size is {} but expected <= {}", size, MaxShortRefSize)};
-    }
-    if (offset >= ShortRefOffsetLimit) {
-      throw std::out_of_range{
-          std::format("Short reference offset is {} but expected < {}", offset, ShortRefOffsetLimit)};
-    }
-
-    AddControlBit(0);
-    AddControlBit(0);
-    AddControlBit((size - 2) >> 1);
-    AddControlBit((size - 2) & 0x1);
-    mOut = static_cast<std::byte>(offset);
+    // 0, 0, then the high and low bits of size - 2
+    const auto sizeBits = static_cast<std::uint32_t>(size - 2);
+    AddControlBits<4>(((sizeBits >> 1) << 2) | ((sizeBits & 1) << 3));
+    Put(static_cast<std::byte>(offset));
   }
 
+  // Sizes 3-9 are stored with the offset, and larger sizes in an extra byte
+  template <bool Extended>
   void WriteLongReference(int size, std::ptrdiff_t offset) {
-    if (size > MaxLongRefSize) {
-      throw std::out_of_range{std::format("Long reference size is {} but expected <= {}", size, MaxShortRefSize)};
-    }
-    if (offset >= LongRefOffsetLimit) {
-      throw std::out_of_range{std::format("Long reference offset is {} but expected < {}", offset, LongRefOffsetLimit)};
-    }
+    AddControlBits<2>(0b10);
 
-    AddControlBit(0);
-    AddControlBit(1);
-
-    auto value = offset << 3;
-    if (size <= 9) {
-      value |= size - 2;
+    auto value = static_cast<std::uint32_t>(offset) << 3;
+    if constexpr (!Extended) {
+      value |= static_cast<std::uint32_t>(size - 2);
     }
 
-    mOut = static_cast<std::byte>(value & 0xFF);
-    mOut = static_cast<std::byte>(value >> 8);
+    Put(static_cast<std::byte>(value & 0xFF));
+    Put(static_cast<std::byte>(value >> 8));
 
-    if (size > 9) {
-      mOut = static_cast<std::byte>(size - 10);
+    if constexpr (Extended) {
+      Put(static_cast<std::byte>(size - 10));
     }
   }
 
  private:
-  void AddControlBit(std::uint8_t bit) {
-    if (mControlBitCounter == 8) {
-      mControlBitCounter = 0;
-      mControlByteOffset = std::ssize(mBuffer);
-      mOut = std::byte{bit};
-    } else {
-      mBuffer.at(mControlByteOffset) |= static_cast<std::byte>(bit << mControlBitCounter);
+  // Add Count control bits, the first of them in the lowest bit
+  template <int Count>
+  void AddControlBits(std::uint32_t bits) {
+    static_assert(Count >= 1 && Count <= 8);
+
+    if (mControlCount + Count <= 8) {
+      mControl |= bits << mControlCount;
+      mControlCount += Count;
+      return;
     }
 
-    mControlBitCounter++;
+    // Fill the current byte, then continue in a new one at the end of the output
+    const auto fitting = 8 - mControlCount;
+    mControl |= bits << mControlCount;
+    StoreControl();
+
+    mControlByte = mOut++;
+    mControl = bits >> fitting;
+    mControlCount = Count - fitting;
   }
 
+  void StoreControl() { *mControlByte = static_cast<std::byte>(mControl & 0xFF) ^ mXorKey; }
+
+  void Put(std::byte value) { *mOut++ = value ^ mXorKey; }
+
   std::vector<std::byte>& mBuffer;
-  std::back_insert_iterator<std::vector<std::byte>> mOut;
-  int mControlBitCounter = 2;
-  std::ptrdiff_t mControlByteOffset = 0;
+  std::byte* mOut = nullptr;
+  std::byte mXorKey;
+  // Control bits that are not stored yet, and where they go
+  std::byte* mControlByte = nullptr;
+  std::uint32_t mControl = 0;
+  int mControlCount = 0;
 };
 
-}  // namespace
+// Encoded sizes in bits, including control bits
+constexpr std::uint32_t LiteralCost = 1 + 8;
+constexpr std::uint32_t ShortRefCost = 4 + 8;
+constexpr std::uint32_t LongRefCost = 2 + 16;
+constexpr std::uint32_t LongRefExtendedCost = LongRefCost + 8;
 
-std::vector<std::byte> Compress(std::span<const std::byte> inputBuffer) {
-  if (inputBuffer.size() < 2) {
-    throw std::out_of_range{"Input must be at least 2 bytes"};
+constexpr std::ptrdiff_t OptimalBlockSize = 1 << 16;
+
+bool IsShortReference(const Match& match) {
+  return match.size <= MaxShortRefSize && match.distance < ShortRefOffsetLimit;
+}
+
+std::uint32_t Cost(const Match& match) {
+  if (IsShortReference(match)) {
+    return ShortRefCost;
   }
+  return match.size <= 9 ? LongRefCost : LongRefExtendedCost;
+}
 
-  std::vector<std::byte> outputBuffer{};
-  outputBuffer.reserve(inputBuffer.size());
-  CompressState output{outputBuffer};
+// Is a literal followed by the next match cheaper per byte than taking the current match?
+bool IsDeferralBetter(const Match& match, const Match& next) {
+  return next.size && (LiteralCost + Cost(next)) * match.size < Cost(match) * (next.size + 1);
+}
+
+void WriteMatch(CompressState& output, const Match& match) {
+  if (IsShortReference(match)) {
+    output.WriteShortReference(match.size, ShortRefOffsetLimit - match.distance);
+  } else if (match.size <= 9) {
+    output.WriteLongReference<false>(match.size, LongRefOffsetLimit - match.distance);
+  } else {
+    output.WriteLongReference<true>(match.size, LongRefOffsetLimit - match.distance);
+  }
+}
 
-  auto dictionary = BuildOffsetDictionary(inputBuffer);
+// Takes the longest match at each position. With lazy matching, a match is deferred by one byte whenever the match
+// starting at the next byte is cheaper.
+void ParseGreedy(std::span<const std::byte> input, std::ptrdiff_t start, MatchFinder& finder, CompressState& output,
+                 bool lazy) {
+  const auto length = std::ssize(input);
+  std::ptrdiff_t currentOffset = start;
+  std::ptrdiff_t insertedOffset = start;
+
+  auto advance = [&](std::ptrdiff_t size) {
+    currentOffset += size;
+    for (; insertedOffset < currentOffset; insertedOffset++) {
+      finder.Insert(insertedOffset);
+    }
+  };
+
+  while (currentOffset < length) {
+    auto match = finder.Find(currentOffset).longest;
+
+    if (lazy) {
+      while (match.size && match.size < MaxLongRefSize) {
+        advance(0);
+        finder.Insert(insertedOffset++);
+
+        const auto next = finder.Find(currentOffset + 1).longest;
+        if (!IsDeferralBetter(match, next)) {
+          break;
+        }
+
+        output.WriteByte(input[currentOffset]);
+        advance(1);
+        match = next;
+      }
+    }
 
-  auto input = inputBuffer.begin();
-  const auto end = inputBuffer.end();
-  const auto length = std::ssize(inputBuffer);
+    if (!match.size) {
+      output.WriteByte(input[currentOffset]);
+      advance(1);
+    } else {
+      WriteMatch(output, match);
+      advance(match.size);
+    }
+  }
+}
 
-  const auto d0 = *input++;
-  const auto d1 = *input++;
-  output.WriteStart(d0, d1);
+// Finds the cheapest encoding of each block by dynamic programming over the encoded size in bits. References are
+// clipped to the end of the block so that each block can be resolved independently.
+void ParseOptimal(std::span<const std::byte> input, std::ptrdiff_t start, MatchFinder& finder, CompressState& output,
+                  Workspace& workspace) {
+  const auto length = std::ssize(input);
+
+  auto& cost = workspace.cost;
+  auto& step = workspace.step;
+  auto& path = workspace.path;
+  cost.resize(OptimalBlockSize + 1);
+  step.resize(OptimalBlockSize + 1);
+
+  for (auto blockStart = start; blockStart < length; blockStart += OptimalBlockSize) {
+    const auto blockSize = std::min(length - blockStart, OptimalBlockSize);
+
+    std::fill_n(cost.begin(), blockSize + 1, std::numeric_limits<std::uint32_t>::max());
+    cost[0] = 0;
+
+    auto relax = [&](std::ptrdiff_t from, const Match& match, std::uint32_t price) {
+      const auto to = from + match.size;
+      if (cost[from] + price < cost[to]) {
+        cost[to] = cost[from] + price;
+        step[to] = match;
+      }
+    };
 
-  while (input != end) {
-    const auto currentOffset = input - inputBuffer.begin();
-    const auto& offsetList = GetOffsetList(dictionary, *input, currentOffset);
+    for (std::ptrdiff_t i = 0; i < blockSize; i++) {
+      const auto candidates = finder.Find(blockStart + i);
+      finder.Insert(blockStart + i);
 
-    auto refSize = 2;
-    std::ptrdiff_t refOffset = -1;
-    std::ptrdiff_t minOffset = currentOffset - ShortRefOffsetLimit;
+      relax(i, {1, 0}, LiteralCost);
 
-    for (auto i = offsetList.second; i < std::ssize(offsetList.first) && offsetList.first[i] < currentOffset; i++) {
-      auto testOffset = offsetList.first[i];
-      auto testSize = 0;
-      const auto maxSize = std::min(length - currentOffset, ShortRefOffsetLimit);
+      const auto remaining = static_cast<int>(std::min<std::ptrdiff_t>(blockSize - i, MaxLongRefSize));
 
-      while (testSize < maxSize && inputBuffer[testOffset + testSize] == inputBuffer[currentOffset + testSize]) {
-        testSize++;
+      const auto& nearby = candidates.nearby;
+      for (auto size = 2; size <= std::min({nearby.size, MaxShortRefSize, remaining}); size++) {
+        relax(i, {size, nearby.distance}, ShortRefCost);
       }
 
-      if ((testSize > 2 || testOffset > minOffset) &&
-          (testSize > refSize || (testSize == refSize && testOffset > refOffset))) {
-        refSize = testSize;
-        refOffset = testOffset;
+      const auto& longest = candidates.longest;
+      for (auto size = 3; size <= std::min(longest.size, remaining); size++) {
+        const Match match{size, longest.distance};
+        relax(i, match, Cost(match));
       }
     }
 
-    if (refOffset < 0 || (currentOffset - refOffset > ShortRefOffsetLimit && refSize < 3)) {
-      output.WriteByte(*input++);
-    } else {
-      if (refSize <= MaxShortRefSize && currentOffset - refOffset < ShortRefOffsetLimit) {
-        output.WriteShortReference(refSize, refOffset - (currentOffset - ShortRefOffsetLimit));
+    path.clear();
+    for (auto i = blockSize; i > 0; i -= step[i].size) {
+      path.push_back(step[i]);
+    }
+
+    auto offset = blockStart;
+    for (auto match = path.rbegin(); match != path.rend(); ++match) {
+      if (match->size == 1) {
+        output.WriteByte(input[offset]);
       } else {
-        output.WriteLongReference(refSize, refOffset - (currentOffset - LongRefOffsetLimit));
+        WriteMatch(output, *match);
       }
-
-      input += refSize;
+      offset += match->size;
     }
   }
+}
+
+void ValidateOptions(const CompressOptions& options) {
+  if (options.searchDepth < 1) {
+    throw std::out_of_range{"Search depth must be at least 1"};
+  }
+}
+
+void CompressInto(std::span<const std::byte> inputBuffer, const CompressOptions& options,
+                  std::span<const std::byte> dictionary, Workspace& workspace, std::vector<std::byte>& outputBuffer) {
+  if (inputBuffer.size() < 2) {
+    throw std::out_of_range{"Input must be at least 2 bytes"};
+  }
+
+  CompressState output{outputBuffer, inputBuffer.size(), options.xorKey};
+
+  // Parse the input as if it followed the end of the dictionary, so references can reach back into it
+  auto data = inputBuffer;
+  const auto prefix = dictionary.last(std::min<std::size_t>(dictionary.size(), WindowSize));
+  if (!prefix.empty()) {
+    workspace.primed.assign(prefix.begin(), prefix.end());
+    workspace.primed.insert(workspace.primed.end(), inputBuffer.begin(), inputBuffer.end());
+    data = workspace.primed;
+  }
+
+  // The stream always starts with two literals
+  const auto start = std::ssize(prefix) + 2;
+
+  MatchFinder finder{data, options.searchDepth, workspace.tables};
+  for (std::ptrdiff_t i = 0; i < start; i++) {
+    finder.Insert(i);
+  }
+
+  output.WriteStart(inputBuffer[0], inputBuffer[1]);
+
+  switch (options.parser) {
+    case Parser::Greedy:
+      ParseGreedy(data, start, finder, output, false);
+      break;
+    case Parser::Lazy:
+      ParseGreedy(data, start, finder, output, true);
+      break;
+    case Parser::Optimal:
+      ParseOptimal(data, start, finder, output, workspace);
+      break;
+  }
 
   output.WriteEnd();
+}
+
+}  // namespace
+
+CompressOptions CompressOptions::FromLevel(int level) {
+  // A better parser only makes up for a shallower search on some inputs, so each parser starts at the search depth of
+  // the one before it. Higher levels usually compress better but are not guaranteed to: a lazy or optimal parse can
+  // still come out a little larger than the greedy or lazy one below it. 8192 candidates covers the whole window.
+  //
+  // The optimal levels are slow on data with long runs of one value, where most positions have thousands of
+  // candidates. 2 MB of zero padded records takes 13-35 s at levels 7-9, where the original exhaustive greedy
+  // compressor took about 1.9 s.
+  static constexpr std::array<CompressOptions, 10> Levels{{
+      {Parser::Greedy, 1},
+      {Parser::Greedy, 16},
+      {Parser::Greedy, 256},
+      {Parser::Lazy, 256},
+      {Parser::Lazy, 512},
+      {Parser::Lazy, 1024},
+      {Parser::Lazy, 2048},
+      {Parser::Optimal, 2048},
+      {Parser::Optimal, 4096},
+      {Parser::Optimal, 8192},
+  }};
+
+  if (level < 0 || level >= std::ssize(Levels)) {
+    throw std::out_of_range{std::format("Compression level is {} but expected 0-{}", level, Levels.size() - 1)};
+  }
+
+  return Levels[level];
+}
+
+std::vector<std::byte> Compress(std::span<const std::byte> inputBuffer, const CompressOptions& options,
+                                std::span<const std::byte> dictionary) {
+  ValidateOptions(options);
+
+  const Stats::Timer timer{Stats::Stage::PrsCompress, inputBuffer.size()};
+  Workspace workspace;
+  std::vector<std::byte> outputBuffer{};
+  CompressInto(inputBuffer, options, dictionary, workspace, outputBuffer);
   return outputBuffer;
 }
 
+struct Compressor::State : Workspace {
+  std::vector<std::byte> output;
+};
+
+Compressor::Compressor(const CompressOptions& options) : mOptions{options} {
+  ValidateOptions(options);
+  mState = std::make_unique<State>();
+}
+
+Compressor::~Compressor() = default;
+
+std::span<const std::byte> Compressor::Compress(std::span<const std::byte> input,
+                                                std::span<const std::byte> dictionary) {
+  const Stats::Timer timer{Stats::Stage::PrsCompress, input.size()};
+  CompressInto(input, mOptions, dictionary, *mState, mState->output);
+  return mState->output;
+}
+
 }  // namespace Prs
 }  // namespace Zamboni
\ No newline at end of file
@@ -1,103 +1,296 @@
+#include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <span>
 #include <stdexcept>
 #include <vector>
 
 #include "prs.hpp"
+#include "stats.hpp"
 
 namespace Zamboni {
 namespace Prs {
 
 namespace {
 
+// Enough input for a control byte and an 8 byte read, which covers any single token
+constexpr std::ptrdiff_t FastPathInputSize = 16;
+constexpr std::ptrdiff_t MaxReferenceSize = 0xFF + 10;
+constexpr std::ptrdiff_t WideCopySlack = 16;
+constexpr std::ptrdiff_t FastPathOutputSize = MaxReferenceSize + WideCopySlack;
+
+// Reads are bounds checked when Checked is true. Otherwise the caller must ensure that CanReadToken() is true at the
+// start of each token.
 class DecompressState {
  public:
-  explicit DecompressState(std::span<const std::byte> input) : mCur{std::begin(input)}, mEnd{std::end(input)} {}
+  DecompressState(std::span<const std::byte> input, std::byte xorKey)
+      : mCur{input.data()},
+        mEnd{input.data() + input.size()},
+        mXorKey{xorKey},
+        mXorMask{std::to_integer<std::uint64_t>(xorKey) * 0x0101010101010101} {}
+
+  bool CanReadToken() const { return mEnd - mCur >= FastPathInputSize; }
+
+  // Copy the run of literals left in the current control byte with a single 8 byte write, so dest must have room for
+  // 8 bytes. Returns the number of literals, which is 0 if the next token is a reference. Unchecked only.
+  std::ptrdiff_t ReadLiteralRun(std::byte* dest) {
+    if (mControlBits == 1) {
+      mControlBits = ReadU8<false>() | 0x100;
+    }
+
+    const auto remaining = static_cast<int>(std::bit_width(mControlBits)) - 1;
+    const auto count = std::min(std::countr_one(mControlBits), remaining);
 
+    std::uint64_t value;
+    std::memcpy(&value, mCur, sizeof(value));
+    value ^= mXorMask;
+    std::memcpy(dest, &value, sizeof(value));
+
+    mCur += count;
+    mControlBits >>= count;
+    return count;
+  }
+
+  template <bool Checked>
   std::byte ReadByte() {
-    if (mCur == mEnd) {
-      throw std::out_of_range{"Read past end of input"};
+    if constexpr (Checked) {
+      if (mCur == mEnd) {
+        throw std::out_of_range{"Read past end of input"};
+      }
     }
 
-    return *mCur++;
+    return *mCur++ ^ mXorKey;
   }
 
-  std::uint16_t ReadU8() { return std::to_integer<std::uint8_t>(ReadByte()); }
+  template <bool Checked>
+  std::uint16_t ReadU8() {
+    return std::to_integer<std::uint8_t>(ReadByte<Checked>());
+  }
 
+  template <bool Checked>
   std::uint16_t ReadU16() {
-    const auto byte0 = std::to_integer<std::uint16_t>(ReadByte());
-    const auto byte1 = std::to_integer<std::uint16_t>(ReadByte());
+    const auto byte0 = std::to_integer<std::uint16_t>(ReadByte<Checked>());
+    const auto byte1 = std::to_integer<std::uint16_t>(ReadByte<Checked>());
 
     return (byte1 << 8) + byte0;
   }
 
+  template <bool Checked>
   bool GetControlBit() {
-    static constexpr auto LSB = std::byte{0x1};
-
-    mControlByteCounter--;
-    if (mControlByteCounter == 0) {
-      mControlByte = ReadByte();
-      mControlByteCounter = 8;
+    // A marker bit above the remaining control bits shows when the byte is used up
+    if (mControlBits == 1) {
+      mControlBits = ReadU8<Checked>() | 0x100;
     }
 
-    const auto result = static_cast<bool>(mControlByte & LSB);
-    mControlByte >>= 1;
+    const auto result = static_cast<bool>(mControlBits & 1);
+    mControlBits >>= 1;
     return result;
   }
 
  private:
-  std::span<const std::byte>::iterator mCur;
-  std::span<const std::byte>::iterator mEnd;
-  std::byte mControlByte{};
-  int mControlByteCounter = 1;
+  const std::byte* mCur;
+  const std::byte* mEnd;
+  std::byte mXorKey;
+  std::uint64_t mXorMask;
+  unsigned mControlBits = 1;
 };
 
-}  // namespace
+// Copy a reference without writing past its end
+void CopyReference(std::byte* dest, std::ptrdiff_t distance, std::ptrdiff_t size) {
+  const std::byte* src = dest - distance;
+  for (; size > 0; size--) {
+    *dest++ = *src++;
+  }
+}
 
-std::vector<std::byte> Decompress(std::span<const std::byte> inputBuffer, std::ptrdiff_t outSize) {
-  DecompressState input{inputBuffer};
-  std::vector<std::byte> output(outSize);
+// Copy a reference 8 bytes at a time, which may write up to WideCopySlack bytes past its end. A reference closer than
+// 8 bytes repeats a short pattern, so first repeat the pattern until it is at least 8 bytes long.
+void CopyReferenceWide(std::byte* dest, std::ptrdiff_t distance, std::ptrdiff_t size) {
+  if (distance < 8) {
+    const auto pattern = distance * ((8 + distance - 1) / distance);
+    for (auto i = 0; i < pattern; i++) {
+      dest[i] = dest[i - distance];
+    }
+
+    dest += pattern;
+    size -= pattern;
+    distance = pattern;
+  }
 
-  std::ptrdiff_t outIndex = 0;
-  while (outIndex < outSize) {
-    while (input.GetControlBit()) {
-      output.at(outIndex++) = input.ReadByte();
+  const std::byte* src = dest - distance;
+  for (; size > 0; src += 8, dest += 8, size -= 8) {
+    std::memcpy(dest, src, 8);
+  }
+}
+
+// Decode one literal or reference. Returns false at the end of the stream.
+//
+// The unchecked version assumes that the input has a whole token left and that the output has room for the longest
+// reference plus the slack of a wide copy, so it only validates the reference distance. The checked version handles
+// the ends of both buffers and never writes past the data it decodes.
+template <bool Checked>
+bool DecodeToken(DecompressState& input, std::span<std::byte> output, std::ptrdiff_t& outIndex) {
+  if constexpr (!Checked) {
+    if (const auto count = input.ReadLiteralRun(output.data() + outIndex)) {
+      outIndex += count;
+      return true;
     }
+  }
 
-    int offset = 0;
-    int loadSize = 0;
+  if (input.GetControlBit<Checked>()) {
+    const auto value = input.ReadByte<Checked>();
 
-    if (input.GetControlBit()) {
-      const auto loadInfo = input.ReadU16();
-      if (!loadInfo) {
-        break;
+    if constexpr (Checked) {
+      if (outIndex >= std::ssize(output)) {
+        throw std::out_of_range{"Write past end of output"};
       }
+    }
 
-      const auto size = loadInfo & 0x7;
+    output[outIndex++] = value;
+    return true;
+  }
 
-      offset = static_cast<int>(loadInfo >> 3) - 0x2000;
-      loadSize = size ? size + 2 : input.ReadU8() + 10;
-    } else {
-      loadSize = 2;
-      if (input.GetControlBit()) {
-        loadSize += 2;
-      }
-      if (input.GetControlBit()) {
-        loadSize += 1;
-      }
+  std::ptrdiff_t offset = 0;
+  std::ptrdiff_t loadSize = 0;
+
+  if (input.GetControlBit<Checked>()) {
+    const auto loadInfo = input.ReadU16<Checked>();
+    if (!loadInfo) {
+      return false;
+    }
+
+    const auto size = loadInfo & 0x7;
+
+    offset = static_cast<std::ptrdiff_t>(loadInfo >> 3) - 0x2000;
+    loadSize = size ? size + 2 : input.ReadU8<Checked>() + 10;
+  } else {
+    // Add the size bits arithmetically, as branching on them mispredicts
+    loadSize = 2 + 2 * input.GetControlBit<Checked>();
+    loadSize += input.GetControlBit<Checked>();
+
+    offset = static_cast<std::ptrdiff_t>(input.ReadU8<Checked>()) - 0x100;
+  }
+
+  if (outIndex + offset < 0) {
+    throw std::out_of_range{"Reference before start of output"};
+  }
 
-      offset = static_cast<int>(input.ReadU8()) - 0x100;
+  if constexpr (Checked) {
+    const auto available = std::ssize(output) - outIndex;
+    if (loadSize > available) {
+      // Keep the bytes that fit, as they are still valid output
+      CopyReference(output.data() + outIndex, -offset, available);
+      outIndex += available;
+      throw std::out_of_range{"Write past end of output"};
     }
 
-    auto loadIndex = outIndex + offset;
+    CopyReference(output.data() + outIndex, -offset, loadSize);
+  } else {
+    CopyReferenceWide(output.data() + outIndex, -offset, loadSize);
+  }
+
+  outIndex += loadSize;
+  return true;
+}
+
+// Decode tokens until outIndex reaches limit. Returns false at the end of the stream. A token that starts before limit
+// must fit in the output. Decoding stops once the output is full, so the end of the stream may be missing after a
+// literal or a reference that fills it.
+bool DecodeTokens(DecompressState& input, std::span<std::byte> output, std::ptrdiff_t& outIndex,
+                  std::ptrdiff_t limit) {
+  const auto outSize = std::ssize(output);
+
+  while (outIndex < limit) {
+    while (input.CanReadToken() && outIndex < limit && outSize - outIndex >= FastPathOutputSize) {
+      if (!DecodeToken<false>(input, output, outIndex)) {
+        return false;
+      }
+    }
+
+    if (outIndex >= limit) {
+      break;
+    }
 
-    for (int i = 0; i < loadSize; i++) {
-      output.at(outIndex++) = output.at(loadIndex++);
+    if (!DecodeToken<true>(input, output, outIndex)) {
+      return false;
     }
   }
 
+  return true;
+}
+
+// References reach at most this far back
+constexpr std::ptrdiff_t HistorySize = 0x2000;
+
+}  // namespace
+
+std::ptrdiff_t Decompress(std::span<const std::byte> inputBuffer, std::span<std::byte> output, std::byte xorKey,
+                          std::span<const std::byte> dictionary) {
+  Stats::Timer timer{Stats::Stage::PrsDecompress, 0};
+  DecompressState input{inputBuffer, xorKey};
+
+  if (dictionary.empty()) {
+    std::ptrdiff_t outIndex = 0;
+    DecodeTokens(input, output, outIndex, std::ssize(output));
+    timer.SetBytes(outIndex);
+    return outIndex;
+  }
+
+  // Decode after a copy of the dictionary, so references into it resolve like any other
+  const auto prefix = dictionary.last(std::min<std::size_t>(dictionary.size(), MaxDictionarySize));
+  std::vector<std::byte> buffer(prefix.size() + output.size());
+  std::ranges::copy(prefix, buffer.begin());
+
+  auto outIndex = std::ssize(prefix);
+  DecodeTokens(input, buffer, outIndex, std::ssize(buffer));
+
+  const auto size = outIndex - std::ssize(prefix);
+  std::copy_n(buffer.begin() + std::ssize(prefix), size, output.begin());
+  timer.SetBytes(size);
+  return size;
+}
+
+std::vector<std::byte> Decompress(std::span<const std::byte> inputBuffer, std::ptrdiff_t outSize, std::byte xorKey) {
+  std::vector<std::byte> output(outSize);
+  Decompress(inputBuffer, output, xorKey);
   return output;
 }
 
+class StreamDecompressor::State : public DecompressState {
+  using DecompressState::DecompressState;
+};
+
+StreamDecompressor::StreamDecompressor(std::span<const std::byte> input, std::ptrdiff_t outSize, std::byte xorKey)
+    : mState{std::make_unique<State>(input, xorKey)},
+      mWindow(HistorySize + PieceSize + FastPathOutputSize),
+      mRemaining{outSize} {}
+
+StreamDecompressor::~StreamDecompressor() = default;
+
+std::span<const std::byte> StreamDecompressor::Read() {
+  if (mEnded || mRemaining <= 0) {
+    return {};
+  }
+
+  // Keep only the output that later references can reach
+  if (mIndex > HistorySize) {
+    std::memmove(mWindow.data(), mWindow.data() + mIndex - HistorySize, HistorySize);
+    mIndex = HistorySize;
+  }
+
+  Stats::Timer timer{Stats::Stage::PrsDecompress, 0};
+  const auto start = mIndex;
+  const auto output = std::span{mWindow}.first(std::min(std::ssize(mWindow), start + mRemaining));
+
+  mEnded = !DecodeTokens(*mState, output, mIndex, std::min(std::ssize(output), start + PieceSize));
+  mRemaining -= mIndex - start;
+  timer.SetBytes(mIndex - start);
+
+  return std::span{mWindow}.subspan(start, mIndex - start);
+}
+
 }  // namespace Prs
 }  // namespace Zamboni
\ No newline at end of file
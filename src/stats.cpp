@@ -0,0 +1,13 @@
+#include "stats.hpp"
+
+namespace Zamboni {
+namespace Stats {
+namespace Internal {
+
+std::atomic<bool> enabled{false};
+std::array<AtomicCounter, StageCount> counters{};
+thread_local Counters threadCounters{};
+
+}  // namespace Internal
+}  // namespace Stats
+}  // namespace Zamboni
\ No newline at end of file
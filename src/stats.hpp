@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Zamboni {
+namespace Stats {
+
+// Parts of reading and writing archives that are timed separately. Stages do not nest, so their times can be added up.
+enum class Stage {
+  Io,
+  Floatage,
+  Blowfish,
+  KrakenCompress,
+  KrakenDecompress,
+  PrsCompress,
+  PrsDecompress,
+  Crc,
+  Split,
+  Combine,
+};
+
+constexpr std::size_t StageCount = 10;
+
+constexpr std::array<std::string_view, StageCount> StageNames = {
+    "io",           "floatage",       "blowfish", "kraken_compress", "kraken_decompress",
+    "prs_compress", "prs_decompress", "crc",      "split",           "combine",
+};
+
+struct Counter {
+  std::uint64_t calls = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t nanoseconds = 0;
+};
+
+using Counters = std::array<Counter, StageCount>;
+
+namespace Internal {
+
+struct AtomicCounter {
+  std::atomic<std::uint64_t> calls{0};
+  std::atomic<std::uint64_t> bytes{0};
+  std::atomic<std::uint64_t> nanoseconds{0};
+};
+
+// Defined in stats.cpp rather than inline, so that each extension module keeps its own copy. Inline variables may be
+// merged between shared libraries, which would count every stage once per module.
+extern std::atomic<bool> enabled;
+extern std::array<AtomicCounter, StageCount> counters;
+// The same counts for the stages run on each thread, so work can be measured while other threads are busy
+extern thread_local Counters threadCounters;
+
+}  // namespace Internal
+
+// Counting is off by default, so the only cost of an untimed call is checking this flag
+inline bool Enabled() { return Internal::enabled.load(std::memory_order_relaxed); }
+
+inline void SetEnabled(bool enabled) { Internal::enabled.store(enabled, std::memory_order_relaxed); }
+
+inline void Add(Stage stage, std::uint64_t bytes, std::uint64_t nanoseconds) {
+  auto& counter = Internal::counters[static_cast<std::size_t>(stage)];
+  counter.calls.fetch_add(1, std::memory_order_relaxed);
+  counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  counter.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+  auto& threadCounter = Internal::threadCounters[static_cast<std::size_t>(stage)];
+  threadCounter.calls++;
+  threadCounter.bytes += bytes;
+  threadCounter.nanoseconds += nanoseconds;
+}
+
+// Totals of every thread
+inline Counters Snapshot() {
+  Counters result{};
+  for (std::size_t i = 0; i < StageCount; i++) {
+    const auto& counter = Internal::counters[i];
+    result[i] = {
+        .calls = counter.calls.load(std::memory_order_relaxed),
+        .bytes = counter.bytes.load(std::memory_order_relaxed),
+        .nanoseconds = counter.nanoseconds.load(std::memory_order_relaxed),
+    };
+  }
+  return result;
+}
+
+// Totals of the calling thread, which are not affected by Reset()
+inline Counters ThreadSnapshot() { return Internal::threadCounters; }
+
+// What the calling thread added since an earlier ThreadSnapshot()
+inline Counters ThreadSince(const Counters& start) {
+  auto result = ThreadSnapshot();
+  for (std::size_t i = 0; i < StageCount; i++) {
+    result[i].calls -= start[i].calls;
+    result[i].bytes -= start[i].bytes;
+    result[i].nanoseconds -= start[i].nanoseconds;
+  }
+  return result;
+}
+
+// Add counters that were measured separately, such as on other threads
+inline void Accumulate(Counters& total, const Counters& more) {
+  for (std::size_t i = 0; i < StageCount; i++) {
+    total[i].calls += more[i].calls;
+    total[i].bytes += more[i].bytes;
+    total[i].nanoseconds += more[i].nanoseconds;
+  }
+}
+
+inline void Reset() {
+  for (auto& counter : Internal::counters) {
+    counter.calls.store(0, std::memory_order_relaxed);
+    counter.bytes.store(0, std::memory_order_relaxed);
+    counter.nanoseconds.store(0, std::memory_order_relaxed);
+  }
+}
+
+// Adds the time until it goes out of scope to a stage, if counting was enabled when it was created. bytes is the amount
+// of uncompressed data the stage works on, so compression and decompression speeds compare directly.
+class Timer {
+ public:
+  Timer(Stage stage, std::size_t bytes) : mStage{stage}, mBytes{bytes}, mEnabled{Enabled()} {
+    if (mEnabled) {
+      mStart = std::chrono::steady_clock::now();
+    }
+  }
+
+  Timer(const Timer&) = delete;
+  Timer& operator=(const Timer&) = delete;
+  Timer(Timer&&) = delete;
+  Timer& operator=(Timer&&) = delete;
+
+  ~Timer() {
+    if (mEnabled) {
+      const auto elapsed = std::chrono::steady_clock::now() - mStart;
+      Add(mStage, mBytes, std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+  }
+
+  // For stages that only know how much they worked on at the end
+  void SetBytes(std::size_t bytes) { mBytes = bytes; }
+
+ private:
+  Stage mStage;
+  std::size_t mBytes;
+  bool mEnabled;
+  std::chrono::steady_clock::time_point mStart{};
+};
+
+}  // namespace Stats
+}  // namespace Zamboni
\ No newline at end of file
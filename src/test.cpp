@@ -87,7 +87,12 @@ int main(int argc, char* argv[]) {
 
     if (result.count("prs")) {
       std::cout << "Testing PRS\n";
-      RoundTripTest(file, Zamboni::Prs::Compress, Zamboni::Prs::Decompress);
+      RoundTripTest(
+          file,
+          [level](auto buffer) {
+            return Zamboni::Prs::Compress(buffer, Zamboni::Prs::CompressOptions::FromLevel(level));
+          },
+          [](auto buffer, auto outSize) { return Zamboni::Prs::Decompress(buffer, outSize); });
     }
 
     if (result.count("kraken")) {
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace Zamboni {
+
+// Work-stealing thread pool. Each worker runs tasks from the back of its own queue and, once that is empty, steals from
+// the front of the other queues, so a worker that draws a few large tasks does not hold up the rest.
+//
+// Tasks must not throw.
+class ThreadPool {
+ public:
+  using Task = std::function<void()>;
+
+  // threads = 0 uses DefaultThreadCount()
+  explicit ThreadPool(int threads = 0) {
+    if (threads <= 0) {
+      threads = DefaultThreadCount();
+    }
+
+    for (auto i = 0; i < threads; i++) {
+      mQueues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < mQueues.size(); i++) {
+      mWorkers.emplace_back([this, i](std::stop_token stop) { Run(i, stop); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  // Runs the remaining tasks, then stops the workers
+  ~ThreadPool() {
+    Wait();
+
+    for (auto& worker : mWorkers) {
+      worker.request_stop();
+    }
+    {
+      const std::lock_guard lock{mMutex};
+      mWake.notify_all();
+    }
+  }
+
+  std::size_t ThreadCount() const { return mWorkers.size(); }
+
+  // Queue a task. Tasks are spread across the workers' queues in turn.
+  void Submit(Task task) {
+    auto& queue = *mQueues[mNextQueue++ % mQueues.size()];
+    {
+      const std::lock_guard lock{queue.mutex};
+      queue.tasks.push_back(std::move(task));
+    }
+
+    const std::lock_guard lock{mMutex};
+    mQueued++;
+    mPending++;
+    mWake.notify_one();
+  }
+
+  // Block until every task submitted so far has finished
+  void Wait() {
+    std::unique_lock lock{mMutex};
+    mDone.wait(lock, [this] { return mPending == 0; });
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::optional<Task> Take(std::size_t worker) {
+    {
+      auto& own = *mQueues[worker];
+      const std::lock_guard lock{own.mutex};
+      if (!own.tasks.empty()) {
+        auto task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return task;
+      }
+    }
+
+    for (std::size_t i = 1; i < mQueues.size(); i++) {
+      auto& other = *mQueues[(worker + i) % mQueues.size()];
+      const std::lock_guard lock{other.mutex};
+      if (!other.tasks.empty()) {
+        auto task = std::move(other.tasks.front());
+        other.tasks.pop_front();
+        return task;
+      }
+    }
+
+    return std::nullopt;
+  }
+
+  void Run(std::size_t worker, std::stop_token stop) {
+    while (true) {
+      {
+        std::unique_lock lock{mMutex};
+        mWake.wait(lock, [&] { return mQueued > 0 || stop.stop_requested(); });
+        if (mQueued == 0) {
+          return;
+        }
+      }
+
+      // Another worker may have taken the task that woke this one
+      auto task = Take(worker);
+      if (!task) {
+        continue;
+      }
+
+      {
+        const std::lock_guard lock{mMutex};
+        mQueued--;
+      }
+
+      (*task)();
+
+      const std::lock_guard lock{mMutex};
+      if (--mPending == 0) {
+        mDone.notify_all();
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::atomic<std::size_t> mNextQueue{0};
+
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mDone;
+  // Tasks waiting in a queue, and tasks that are queued or running
+  std::size_t mQueued = 0;
+  std::size_t mPending = 0;
+
+  // Last, so the workers stop before the state they use is destroyed
+  std::vector<std::jthread> mWorkers;
+};
+
+}  // namespace Zamboni
\ No newline at end of file
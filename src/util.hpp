@@ -7,6 +7,8 @@
 #include <cstddef>
 #include <span>
 
+#include "stats.hpp"
+
 class PythonRef {
  public:
   explicit PythonRef(PyObject* obj) : mObj{obj} {}
@@ -30,7 +32,118 @@ class PythonRef {
   PyObject* mObj;
 };
 
+// Buffer filled by PyArg_ParseTuple's "y*" or "w*" formats and released when it goes out of scope
+class PythonBuffer {
+ public:
+  PythonBuffer() = default;
+
+  PythonBuffer(const PythonBuffer&) = delete;
+  PythonBuffer& operator=(const PythonBuffer&) = delete;
+  PythonBuffer(PythonBuffer&&) = delete;
+  PythonBuffer& operator=(PythonBuffer&&) = delete;
+
+  ~PythonBuffer() {
+    if (mBuffer.obj) {
+      PyBuffer_Release(&mBuffer);
+    }
+  }
+
+  Py_buffer& operator*() { return mBuffer; }
+  Py_buffer* operator&() { return &mBuffer; }
+
+ private:
+  Py_buffer mBuffer{};
+};
+
+// Releases the GIL for the lifetime of the object. Python objects must not be touched until it is destroyed.
+class GilRelease {
+ public:
+  explicit GilRelease(bool release = true) : mState{release ? PyEval_SaveThread() : nullptr} {}
+
+  GilRelease(const GilRelease&) = delete;
+  GilRelease& operator=(const GilRelease&) = delete;
+  GilRelease(GilRelease&&) = delete;
+  GilRelease& operator=(GilRelease&&) = delete;
+
+  ~GilRelease() {
+    if (mState) {
+      PyEval_RestoreThread(mState);
+    }
+  }
+
+ private:
+  PyThreadState* mState;
+};
+
+// Sets a flag for the lifetime of the object. Objects that release the GIL while using their state set one so that
+// other threads can refuse to use them at the same time. Create it before any GilRelease in the same scope, so that
+// the flag is cleared after the GIL is taken back.
+class BusyFlag {
+ public:
+  explicit BusyFlag(bool& flag) : mFlag{flag} { mFlag = true; }
+
+  BusyFlag(const BusyFlag&) = delete;
+  BusyFlag& operator=(const BusyFlag&) = delete;
+  BusyFlag(BusyFlag&&) = delete;
+  BusyFlag& operator=(BusyFlag&&) = delete;
+
+  ~BusyFlag() { mFlag = false; }
+
+ private:
+  bool& mFlag;
+};
+
 template <class T = std::byte>
 std::span<T> AsSpan(Py_buffer& buffer) {
   return std::span{reinterpret_cast<T*>(buffer.buf), static_cast<std::size_t>(buffer.len / sizeof(T))};
+}
+
+// Contents of a bytes object. Only bytes objects that have not been shared yet may be written to.
+template <class T = std::byte>
+std::span<T> BytesAsSpan(PyObject* bytes) {
+  return std::span{reinterpret_cast<T*>(PyBytes_AS_STRING(bytes)),
+                   static_cast<std::size_t>(PyBytes_GET_SIZE(bytes) / sizeof(T))};
+}
+
+// Stage counters as {stage: (calls, bytes, nanoseconds)}
+inline PyObject* StatsToDict(const Zamboni::Stats::Counters& counters) {
+  auto result = PythonRef(PyDict_New());
+  if (!result) {
+    return nullptr;
+  }
+
+  for (std::size_t i = 0; i < counters.size(); i++) {
+    const auto& counter = counters[i];
+    const auto& name = Zamboni::Stats::StageNames[i];
+
+    auto value = PythonRef(Py_BuildValue("(KKK)", static_cast<unsigned long long>(counter.calls),
+                                         static_cast<unsigned long long>(counter.bytes),
+                                         static_cast<unsigned long long>(counter.nanoseconds)));
+    auto key = PythonRef(PyUnicode_FromStringAndSize(name.data(), std::ssize(name)));
+    if (!value || !key || PyDict_SetItem(*result, *key, *value) < 0) {
+      return nullptr;
+    }
+  }
+
+  return Py_NewRef(*result);
+}
+
+// Stage counters of this module. Every extension module has its own copy of the counters, so zamboni.stats() combines
+// them.
+inline PyObject* GetStats(PyObject*, PyObject*) { return StatsToDict(Zamboni::Stats::Snapshot()); }
+
+inline PyObject* SetStatsEnabled(PyObject*, PyObject* args) {
+  int enabled;
+
+  if (!PyArg_ParseTuple(args, "p", &enabled)) {
+    return nullptr;
+  }
+
+  Zamboni::Stats::SetEnabled(enabled);
+  Py_RETURN_NONE;
+}
+
+inline PyObject* ResetStats(PyObject*, PyObject*) {
+  Zamboni::Stats::Reset();
+  Py_RETURN_NONE;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
 from .icefile import IceFile
 from .pack import pack as pack_ice
 from .unpack import unpack as unpack_ice
+from .profiling import enable_stats, reset_stats, stats
@@ -0,0 +1,143 @@
+"""
+Process many ICE archives at once
+"""
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Iterable, Optional
+
+from . import native
+from .profiling import Stats
+
+# Default bound on the data held between the stages of a pipelined unpack
+DEFAULT_QUEUE_SIZE = 256 << 20
+
+
+@dataclass
+class UnpackResult:
+    """Result of unpacking one archive"""
+
+    path: Path
+    files: list[Path] = field(default_factory=list)
+    # Error message if the archive could not be unpacked
+    error: Optional[str] = None
+    # Stages run for this archive, if the stage counters are enabled
+    stats: Optional[Stats] = None
+
+
+@dataclass
+class VerifyResult:
+    """Result of verifying one archive"""
+
+    path: Path
+    # Problems found in the archive
+    errors: list[str] = field(default_factory=list)
+    # Stages run for this archive, if the stage counters are enabled
+    stats: Optional[Stats] = None
+
+    @property
+    def ok(self) -> bool:
+        """Is the archive intact?"""
+        return not self.errors
+
+
+def find_archives(paths: Iterable[Path | str]) -> list[tuple[Path, Path]]:
+    """
+    Find the archives to process
+
+    :param paths: Archives and/or directories, which are searched recursively
+    :return: (archive, base directory) for each archive found. The base directory
+        is the directory that was searched, or the archive's parent directory.
+    """
+    archives: list[tuple[Path, Path]] = []
+
+    for path in map(Path, paths):
+        if path.is_dir():
+            archives.extend((f, path) for f in sorted(path.rglob("*")) if f.is_file())
+        else:
+            archives.append((path, path.parent))
+
+    return archives
+
+
+def unpack_many(
+    paths: Iterable[Path | str],
+    out_dir: Optional[Path] = None,
+    use_groups=False,
+    dump_raw_data=False,
+    jobs=0,
+    io_jobs=0,
+    queue_size=DEFAULT_QUEUE_SIZE,
+) -> list[UnpackResult]:
+    """
+    Unpack many ICE archives in parallel
+
+    Every archive is read, decrypted, decompressed, split and written without the
+    GIL. An archive that fails to unpack does not stop the others.
+
+    With I/O threads, reading and writing overlap with decoding: archives are read in
+    order ahead of the decoding threads, and each file is written by an I/O thread as
+    soon as it is decoded. At most queue_size bytes of archives are read ahead, and at
+    most queue_size bytes of files wait to be written.
+
+    :param paths: Archives and/or directories to search for archives
+    :param out_dir: Output directory. Each archive is extracted to "<archive>.extracted"
+        at the same path relative to out_dir as the archive is relative to the directory
+        it was found in. Defaults to extracting next to each archive.
+    :param use_groups: If True, write files to "group1" and "group2" subdirectories.
+    :param dump_raw_data: If True, do not strip ICE file headers.
+    :param jobs: Number of decoding threads to use, or 0 for one per CPU
+    :param io_jobs: Number of threads that read and write, or 0 to read and write on
+        the decoding threads
+    :param queue_size: Bytes of archives and of files that may be held between stages
+    :return: Result for each archive, in order
+    """
+    archives = find_archives(paths)
+
+    def get_out_dir(path: Path, base: Path):
+        if out_dir is None:
+            return path.with_suffix(".extracted")
+
+        return out_dir / path.relative_to(base).with_suffix(".extracted")
+
+    results = native.unpack_many(
+        [(path, get_out_dir(path, base)) for path, base in archives],
+        use_groups=use_groups,
+        dump_raw_data=dump_raw_data,
+        threads=jobs,
+        io_threads=io_jobs,
+        queue_size=queue_size,
+    )
+
+    return [
+        UnpackResult(
+            path=path,
+            files=[Path(f) for f in files],
+            error=error,
+            stats=_archive_stats(stats),
+        )
+        for (path, _), (files, error, stats) in zip(archives, results)
+    ]
+
+
+def verify_many(paths: Iterable[Path | str], jobs=0) -> list[VerifyResult]:
+    """
+    Check many ICE archives in parallel without extracting their files
+
+    Every archive is memory-mapped, and each of its groups is checksummed against its
+    group header and decompressed without the GIL. No DataFile objects are created.
+
+    :param paths: Archives and/or directories to search for archives
+    :param jobs: Number of threads to use, or 0 for one per CPU
+    :return: Result for each archive, in order
+    """
+    archives = [path for path, _ in find_archives(paths)]
+    results = native.verify_many(archives, threads=jobs)
+
+    return [
+        VerifyResult(path=path, errors=errors, stats=_archive_stats(stats))
+        for path, (errors, stats) in zip(archives, results)
+    ]
+
+
+def _archive_stats(counters: Optional[dict]) -> Optional[Stats]:
+    return None if counters is None else Stats.from_counters(counters)
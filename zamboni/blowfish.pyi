@@ -0,0 +1,47 @@
+"""
+Blowfish cipher
+
+PSO2 reads each 8-byte block as two little-endian words instead of the usual
+big-endian. Bytes after the last whole block are left unchanged.
+"""
+
+# pylint: disable=unused-argument
+
+from typing import Tuple
+
+def encrypt(data: bytes, key: bytes) -> bytes:
+    """
+    Encrypt data with Blowfish in ECB mode
+
+    :param data: Data to encrypt
+    :param key: Cipher key (1-56 bytes)
+    :raises ValueError:
+    """
+
+def decrypt(data: bytes, key: bytes) -> bytes:
+    """
+    Decrypt data with Blowfish in ECB mode
+
+    :param data: Data to decrypt
+    :param key: Cipher key (1-56 bytes)
+    :raises ValueError:
+    """
+
+def encrypt_inplace(data: bytearray | memoryview, key: bytes) -> None:
+    """Same as encrypt(), but modifies a writable buffer in place"""
+
+def decrypt_inplace(data: bytearray | memoryview, key: bytes) -> None:
+    """Same as decrypt(), but modifies a writable buffer in place"""
+
+def _stats() -> dict[str, Tuple[int, int, int]]:
+    """
+    Get this module's stage counters as {stage: (calls, bytes, nanoseconds)}
+
+    Use zamboni.stats() instead, which combines the counters of every module.
+    """
+
+def _set_stats_enabled(enabled: bool):
+    """Turn the stage counters of this module on or off"""
+
+def _reset_stats():
+    """Set the stage counters of this module to zero"""
@@ -0,0 +1,135 @@
+"""
+On-disk cache of compressed file groups
+"""
+from dataclasses import dataclass
+import hashlib
+import os
+from pathlib import Path
+import tempfile
+from typing import Optional
+
+from .compression import CompressOptions
+
+DEFAULT_MAX_SIZE = 1 << 30
+# Trimming scans the whole cache directory, so once the cache is over its limit it is
+# trimmed to this fraction of it. Many entries can then be added before the next scan.
+TRIM_TARGET = 0.9
+
+
+@dataclass
+class CacheStats:
+    """Counts of cache lookups since the cache was opened"""
+
+    hits: int = 0
+    misses: int = 0
+    evictions: int = 0
+
+    def __str__(self):
+        return f"{self.hits} hits, {self.misses} misses, {self.evictions} evicted"
+
+
+class CompressionCache:
+    """
+    Content-addressed cache of compressed file groups
+
+    Entries are keyed by a hash of the uncompressed group along with the compression
+    mode and level, so a group that is identical to one packed before is copied from
+    the cache instead of being compressed again. Once the cache grows past its size
+    limit, the least recently used entries are removed.
+    """
+
+    def __init__(self, directory: Path | str, max_size=DEFAULT_MAX_SIZE):
+        """
+        :param directory: Directory to store cache entries in. Created if missing.
+        :param max_size: Maximum total size of the cache entries in bytes
+        """
+        self.directory = Path(directory)
+        self.directory.mkdir(parents=True, exist_ok=True)
+        self.max_size = max_size
+        self.stats = CacheStats()
+        self._size = sum(entry.stat().st_size for entry in self._entries())
+
+    @property
+    def size(self) -> int:
+        """Total size of the cache entries in bytes"""
+        return self._size
+
+    def get(self, data: bytes, options: CompressOptions) -> Optional[bytes]:
+        """Get the compressed form of a group, or None if it isn't cached"""
+        path = self._path(data, options)
+
+        try:
+            compressed = path.read_bytes()
+            # Access times are unreliable, so the modified time tracks last use
+            os.utime(path)
+        except FileNotFoundError:
+            self.stats.misses += 1
+            return None
+
+        self.stats.hits += 1
+        return compressed
+
+    def put(self, data: bytes, options: CompressOptions, compressed: bytes):
+        """Add the compressed form of a group to the cache"""
+        path = self._path(data, options)
+
+        # Putting an entry that is already cached replaces it, so only the difference in
+        # size counts towards the total
+        try:
+            replaced = path.stat().st_size
+        except FileNotFoundError:
+            replaced = 0
+
+        # Write to a temporary file first so other processes never see partial entries
+        fd, temp_path = tempfile.mkstemp(dir=self.directory, suffix=".tmp")
+        try:
+            with os.fdopen(fd, "wb") as file:
+                file.write(compressed)
+            os.replace(temp_path, path)
+        except BaseException:
+            os.unlink(temp_path)
+            raise
+
+        self._size += len(compressed) - replaced
+        if self._size > self.max_size:
+            self.trim()
+
+    def trim(self):
+        """
+        Remove least recently used entries until the cache is down to TRIM_TARGET of
+        its size limit
+        """
+        target = int(self.max_size * TRIM_TARGET)
+        entries = []
+        for entry in self._entries():
+            try:
+                stat = entry.stat()
+            except FileNotFoundError:
+                continue
+            entries.append((stat.st_mtime_ns, stat.st_size, entry))
+
+        entries.sort()
+        self._size = sum(size for _, size, _ in entries)
+
+        for _, size, entry in entries:
+            if self._size <= target:
+                break
+
+            entry.unlink(missing_ok=True)
+            self._size -= size
+            self.stats.evictions += 1
+
+    def clear(self):
+        """Remove every entry from the cache"""
+        for entry in self._entries():
+            entry.unlink(missing_ok=True)
+        self._size = 0
+
+    def _path(self, data: bytes, options: CompressOptions):
+        digest = hashlib.blake2b(data, digest_size=20).hexdigest()
+        if options.mode == "auto":
+            return self.directory / f"{digest}-auto-{options.budget:g}"
+        return self.directory / f"{digest}-{options.mode}-{options.level}"
+
+    def _entries(self):
+        return (entry for entry in self.directory.iterdir() if entry.suffix != ".tmp")
@@ -2,16 +2,24 @@
 Command line interface
 """
 import argparse
+import cProfile
 import itertools
 from pathlib import Path
+import pstats
 import re
-from typing import Iterable, Optional
+import sys
+import time
+from typing import Optional, Tuple
 
+from .batch import DEFAULT_QUEUE_SIZE, unpack_many, verify_many
+from .cache import DEFAULT_MAX_SIZE, CompressionCache
 from .compression import CompressOptions
-from .datafile import DataFile
 from .icefile import IceFile
+from .index import ArchiveIndex, IndexedArchive
+from .mapped import MappedIceFile
 from .pack import pack
-from .unpack import unpack
+from .profiling import Stats, enable_stats, reset_stats, stats
+from .unpack import unpack, unpack_group
 from .util import naturalsize
 
 
@@ -24,9 +32,59 @@ def _flatten_args(args: Optional[list[list[str]]]) -> list[str]:
     return []
 
 
+def _add_cache_args(parser: argparse.ArgumentParser):
+    parser.add_argument(
+        "--cache",
+        type=Path,
+        help="directory to cache compressed groups in, reused by later runs",
+    )
+    parser.add_argument(
+        "--cache-size",
+        type=int,
+        default=DEFAULT_MAX_SIZE >> 20,
+        help=f"maximum cache size in MiB (default: {DEFAULT_MAX_SIZE >> 20})",
+    )
+
+
+def _open_cache(args: argparse.Namespace) -> Optional[CompressionCache]:
+    if args.cache is None:
+        return None
+
+    return CompressionCache(args.cache, max_size=args.cache_size << 20)
+
+
+def _add_index_arg(parser: argparse.ArgumentParser, **kwargs):
+    parser.add_argument(
+        "--index",
+        "-x",
+        type=Path,
+        help="archive index file, from the index command",
+        **kwargs,
+    )
+
+
+def _lookup_index(
+    index_path: Optional[Path], ice_path: Path
+) -> Optional[IndexedArchive]:
+    """Get an archive from an index if it is listed and unchanged since indexing"""
+    if index_path is None:
+        return None
+
+    entry = ArchiveIndex.load(index_path).get(ice_path)
+    if entry is None or entry.version == 0 or not entry.is_current():
+        return None
+
+    return entry
+
+
 def main():
     """Main entry point"""
     parser = argparse.ArgumentParser()
+    parser.add_argument(
+        "--profile",
+        action="store_true",
+        help="print the time spent in each stage and the slowest Python functions",
+    )
     subparsers = parser.add_subparsers(dest="command", required=True)
 
     # info command
@@ -38,6 +96,7 @@ def main():
         action="store_true",
         help="print sizes in human-readable format",
     )
+    _add_index_arg(info_parser)
 
     # list command
     list_parser = subparsers.add_parser(
@@ -47,6 +106,38 @@ def main():
     list_parser.add_argument(
         "--groups", "-g", action="store_true", help="use group subdirectories"
     )
+    _add_index_arg(list_parser)
+
+    # index command
+    index_parser = subparsers.add_parser(
+        "index", help="index the files in every ICE archive in a directory"
+    )
+    index_parser.add_argument("directory", type=Path, help="directory to index")
+    _add_index_arg(index_parser, default=Path("zamboni.idx"))
+    index_parser.add_argument(
+        "--rebuild",
+        action="store_true",
+        help="read every archive again instead of only those that changed",
+    )
+    index_parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=0,
+        help="number of archives to read at once (0 = one per CPU, default: 0)",
+    )
+
+    # find command
+    find_parser = subparsers.add_parser(
+        "find", help="find the archives containing files, using an archive index"
+    )
+    find_parser.add_argument(
+        "names", nargs="+", help='file names, which may contain "*" and "?" wildcards'
+    )
+    _add_index_arg(find_parser, default=Path("zamboni.idx"))
+    find_parser.add_argument(
+        "--groups", "-g", action="store_true", help="use group subdirectories"
+    )
 
     # unpack command
     unpack_parser = subparsers.add_parser(
@@ -61,6 +152,85 @@ def main():
         "--raw", "-r", action="store_true", help="Do not strip ICE file headers"
     )
 
+    # extract command
+    extract_parser = subparsers.add_parser(
+        "extract", help="extract some of the files from an ICE archive"
+    )
+    extract_parser.add_argument("icefile", type=Path, help="file to extract from")
+    extract_parser.add_argument(
+        "names", nargs="+", help="names of the files to extract"
+    )
+    extract_parser.add_argument(
+        "--out",
+        "-o",
+        type=Path,
+        default=Path("."),
+        help="output directory (default: current directory)",
+    )
+    extract_parser.add_argument(
+        "--groups", "-g", action="store_true", help="use group subdirectories"
+    )
+    extract_parser.add_argument(
+        "--raw", "-r", action="store_true", help="Do not strip ICE file headers"
+    )
+
+    # unpack-all command
+    unpack_all_parser = subparsers.add_parser(
+        "unpack-all", help="extract files from many ICE archives in parallel"
+    )
+    unpack_all_parser.add_argument(
+        "paths", type=Path, nargs="+", help="files or directories to extract"
+    )
+    unpack_all_parser.add_argument(
+        "--out", "-o", type=Path, help="output directory"
+    )
+    unpack_all_parser.add_argument(
+        "--groups", "-g", action="store_true", help="use group subdirectories"
+    )
+    unpack_all_parser.add_argument(
+        "--raw", "-r", action="store_true", help="Do not strip ICE file headers"
+    )
+    unpack_all_parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=0,
+        help="number of archives to extract at once (0 = one per CPU, default: 0)",
+    )
+    unpack_all_parser.add_argument(
+        "--io-jobs",
+        "-J",
+        type=int,
+        default=0,
+        help="threads that read archives ahead and write files behind the extracting "
+        "threads (0 = read and write on the extracting threads, default: 0)",
+    )
+    unpack_all_parser.add_argument(
+        "--queue-size",
+        type=int,
+        default=DEFAULT_QUEUE_SIZE >> 20,
+        help="MiB of archives to read ahead, and of files waiting to be written, with "
+        f"--io-jobs (default: {DEFAULT_QUEUE_SIZE >> 20})",
+    )
+
+    # verify command
+    verify_parser = subparsers.add_parser(
+        "verify", help="check many ICE archives for corruption in parallel"
+    )
+    verify_parser.add_argument(
+        "paths", type=Path, nargs="+", help="files or directories to check"
+    )
+    verify_parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=0,
+        help="number of archives to check at once (0 = one per CPU, default: 0)",
+    )
+    verify_parser.add_argument(
+        "--verbose", "-V", action="store_true", help="also print intact archives"
+    )
+
     # pack command
     pack_parser = subparsers.add_parser("pack", help="pack files into an ICE archive")
     pack_parser.add_argument(
@@ -75,7 +245,7 @@ def main():
         type=CompressOptions.parse,
         default="kraken",
         nargs="?",
-        help="compression level ('none', 0-9, or 'prs', default: 3)",
+        help="compression level ('none', 0-9, 'prs', 'prs:0-9', or 'auto[:MB/s]', default: 3)",
     )
     pack_parser.add_argument(
         "--encrypt", "-e", action="store_true", help="encrypt the archive"
@@ -99,6 +269,20 @@ def main():
         nargs="*",
         help='file extensions and/or file names to ignore, e.g. ".mp4,.png"',
     )
+    pack_parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=1,
+        help="number of threads to compress with (0 = one per CPU, default: 1)",
+    )
+    pack_parser.add_argument(
+        "--stream",
+        "-s",
+        action="store_true",
+        help="read files as they are compressed instead of loading them all first",
+    )
+    _add_cache_args(pack_parser)
 
     # repack command
     repack_parser = subparsers.add_parser("repack", help="")
@@ -113,7 +297,7 @@ def main():
         type=CompressOptions.parse,
         default="kraken",
         nargs="?",
-        help="compression level ('none', 0-9, or 'prs', default: 3)",
+        help="compression level ('none', 0-9, 'prs', 'prs:0-9', or 'auto[:MB/s]', default: 3)",
     )
     repack_parser.add_argument(
         "--encrypt", "-e", action="store_true", help="encrypt the archive"
@@ -125,15 +309,79 @@ def main():
         default=4,
         help="format version (3 or 4, default: 4)",
     )
+    repack_parser.add_argument(
+        "--jobs",
+        "-j",
+        type=int,
+        default=1,
+        help="number of threads to compress with (0 = one per CPU, default: 1)",
+    )
+    repack_parser.add_argument(
+        "--replace",
+        "-r",
+        type=Path,
+        nargs="*",
+        help="files to replace in the archive, matched by file name",
+    )
+    repack_parser.add_argument(
+        "--incremental",
+        "-I",
+        action="store_true",
+        help="copy groups that are unchanged instead of compressing them again",
+    )
+    _add_cache_args(repack_parser)
 
     args = parser.parse_args()
 
+    if not args.profile:
+        run_command(args)
+        return
+
+    reset_stats()
+    enable_stats()
+    start = time.perf_counter()
+
+    try:
+        with cProfile.Profile() as profile:
+            run_command(args)
+    finally:
+        wall_seconds = time.perf_counter() - start
+        enable_stats(False)
+
+        _print_profile(_profile_label(args), stats(), wall_seconds)
+        pstats.Stats(profile, stream=sys.stderr).sort_stats(
+            pstats.SortKey.CUMULATIVE
+        ).print_stats(20)
+
+
+def run_command(args: argparse.Namespace):
+    """Run the command given on the command line"""
     match args.command:
         case "info":
-            print_info(ice_path=args.icefile, humanize=args.human_readable)
+            print_info(
+                ice_path=args.icefile,
+                humanize=args.human_readable,
+                index_path=args.index,
+            )
 
         case "list":
-            print_file_list(ice_path=args.icefile, use_groups=args.groups)
+            print_file_list(
+                ice_path=args.icefile, use_groups=args.groups, index_path=args.index
+            )
+
+        case "index":
+            index_directory(
+                directory=args.directory,
+                index_path=args.index,
+                rebuild=args.rebuild,
+                jobs=args.jobs,
+            )
+
+        case "find":
+            if not find_files(
+                names=args.names, index_path=args.index, use_groups=args.groups
+            ):
+                sys.exit(1)
 
         case "unpack":
             unpack_file(
@@ -143,7 +391,34 @@ def main():
                 dump_raw_data=args.raw,
             )
 
+        case "extract":
+            if not extract_files(
+                ice_path=args.icefile,
+                names=args.names,
+                out_dir=args.out,
+                use_groups=args.groups,
+                dump_raw_data=args.raw,
+            ):
+                sys.exit(1)
+
+        case "unpack-all":
+            if not unpack_all(
+                paths=args.paths,
+                out_dir=args.out,
+                use_groups=args.groups,
+                dump_raw_data=args.raw,
+                jobs=args.jobs,
+                io_jobs=args.io_jobs,
+                queue_size=args.queue_size << 20,
+            ):
+                sys.exit(1)
+
+        case "verify":
+            if not verify_all(paths=args.paths, jobs=args.jobs, verbose=args.verbose):
+                sys.exit(1)
+
         case "pack":
+            cache = _open_cache(args)
             pack_file(
                 files=args.files,
                 out_path=args.out,
@@ -152,16 +427,44 @@ def main():
                 exclude_files=_flatten_args(args.ignore),
                 compression=args.compress,
                 encrypt=args.encrypt,
+                threads=args.jobs,
+                cache=cache,
+                streaming=args.stream,
             )
+            _print_cache_stats(cache)
 
         case "repack":
+            cache = _open_cache(args)
             repack_file(
                 ice_path=args.icefile,
                 out_path=args.out,
                 version=args.version,
                 compression=args.compress,
                 encrypt=args.encrypt,
+                threads=args.jobs,
+                replace_files=args.replace or [],
+                incremental=args.incremental,
+                cache=cache,
             )
+            _print_cache_stats(cache)
+
+
+def _profile_label(args: argparse.Namespace) -> str:
+    if getattr(args, "icefile", None) is not None:
+        return str(args.icefile)
+    if args.command == "pack":
+        return str(args.out)
+    return "Total"
+
+
+def _print_profile(label: str, archive_stats: Stats, wall_seconds=None):
+    print(f"\n{label}:", file=sys.stderr)
+    print(archive_stats.format(wall_seconds), file=sys.stderr)
+
+
+def _print_cache_stats(cache: Optional[CompressionCache]):
+    if cache:
+        print(f"Compression cache: {cache.stats}", file=sys.stderr)
 
 
 def unpack_file(ice_path: Path, out_dir: Path, use_groups: bool, dump_raw_data: bool):
@@ -172,6 +475,108 @@ def unpack_file(ice_path: Path, out_dir: Path, use_groups: bool, dump_raw_data:
         print(path)
 
 
+def extract_files(
+    ice_path: Path,
+    names: list[str],
+    out_dir: Path,
+    use_groups: bool,
+    dump_raw_data: bool,
+) -> bool:
+    """
+    Extract files with the given names from an ICE archive and print the files written
+
+    :return: True if every file was found
+    """
+    group1_files, group2_files = IceFile.extract(ice_path, names)
+
+    group1_dir = out_dir / "group1" if use_groups else out_dir
+    group2_dir = out_dir / "group2" if use_groups else out_dir
+
+    for files, group_dir in ((group1_files, group1_dir), (group2_files, group2_dir)):
+        if files:
+            for path in unpack_group(files, group_dir, dump_raw_data=dump_raw_data):
+                print(path)
+
+    found = {file.name for file in group1_files + group2_files}
+    missing = [name for name in names if name not in found]
+    for name in missing:
+        print(f"{name} is not in {ice_path}", file=sys.stderr)
+
+    return not missing
+
+
+def unpack_all(
+    paths: list[Path],
+    out_dir: Path,
+    use_groups: bool,
+    dump_raw_data: bool,
+    jobs: int,
+    io_jobs: int,
+    queue_size: int,
+) -> bool:
+    """
+    Extract many ICE archives and print the files extracted
+
+    :return: True if every archive was extracted
+    """
+    results = unpack_many(
+        paths,
+        out_dir=out_dir,
+        use_groups=use_groups,
+        dump_raw_data=dump_raw_data,
+        jobs=jobs,
+        io_jobs=io_jobs,
+        queue_size=queue_size,
+    )
+
+    failed = 0
+    for result in results:
+        if result.stats is not None:
+            _print_profile(str(result.path), result.stats)
+
+        if result.error is not None:
+            failed += 1
+            print(f"{result.path}: {result.error}", file=sys.stderr)
+            continue
+
+        for path in result.files:
+            print(path)
+
+    print(
+        f"Extracted {len(results) - failed} of {len(results)} archives", file=sys.stderr
+    )
+    return failed == 0
+
+
+def verify_all(paths: list[Path], jobs: int, verbose: bool) -> bool:
+    """
+    Check many ICE archives and print the problems found
+
+    :return: True if every archive is intact
+    """
+    results = verify_many(paths, jobs=jobs)
+
+    failed = 0
+    for result in results:
+        if result.stats is not None:
+            _print_profile(str(result.path), result.stats)
+
+        if result.ok:
+            if verbose:
+                print(f"{result.path}: OK")
+            continue
+
+        failed += 1
+        for error in result.errors:
+            print(f"{result.path}: {error}")
+
+    print(
+        f"{len(results) - failed} of {len(results)} archives are intact",
+        file=sys.stderr,
+    )
+    return failed == 0
+
+
 def pack_file(
     files: list[Path],
     out_path: Path,
@@ -180,8 +585,27 @@ def pack_file(
     exclude_files: list[str],
     compression: CompressOptions,
     encrypt: bool,
+    threads: int,
+    cache: Optional[CompressionCache],
+    streaming: bool,
 ):
     """Pack files into an ICE archive"""
+    if streaming:
+        # The streaming writer seeks back to fill in the headers, so it opens the file
+        pack(
+            out_path,
+            files,
+            file_type=version,
+            group1_files=group1_files,
+            exclude_files=exclude_files,
+            compression=compression,
+            encrypt=encrypt,
+            threads=threads,
+            cache=cache,
+            streaming=True,
+        )
+        return
+
     with out_path.open("wb") as f:
         pack(
             f,
@@ -191,6 +615,8 @@ def pack_file(
             exclude_files=exclude_files,
             compression=compression,
             encrypt=encrypt,
+            threads=threads,
+            cache=cache,
         )
 
 
@@ -200,64 +626,150 @@ def repack_file(
     version: int,
     compression: CompressOptions,
     encrypt: bool,
+    threads: int,
+    replace_files: list[Path],
+    incremental: bool,
+    cache: Optional[CompressionCache],
 ):
     """Extract an ICE archive and pack it back into an archive with different options"""
-    ice = IceFile.read(ice_path)
+    ice = IceFile.read(ice_path, keep_source=incremental)
+
+    for path in replace_files:
+        matches = [
+            file
+            for file in itertools.chain(ice.group1_files, ice.group2_files)
+            if file.name == path.name
+        ]
+        if not matches:
+            raise ValueError(f"{path.name} is not in {ice_path}")
+
+        data = path.read_bytes()
+        for file in matches:
+            file.data = data
 
     file_type = IceFile.get_file_type(version)
     if file_type != type(ice):
         new_ice = file_type()
         new_ice.group1_files = ice.group1_files
         new_ice.group2_files = ice.group2_files
+        new_ice.group1_source = ice.group1_source
+        new_ice.group2_source = ice.group2_source
         ice = new_ice
 
     with out_path.open("wb") as f:
-        ice.write(f, compression=compression, encrypt=encrypt)
+        ice.write(
+            f,
+            compression=compression,
+            encrypt=encrypt,
+            threads=threads,
+            incremental=incremental,
+            cache=cache,
+        )
+
+
+def index_directory(directory: Path, index_path: Path, rebuild: bool, jobs: int):
+    """Index the archives in a directory, reading only those that changed"""
+    previous = None
+    if not rebuild and index_path.exists():
+        previous = ArchiveIndex.load(index_path)
+
+    index = ArchiveIndex.build(directory, previous=previous, jobs=jobs)
+    index.save(index_path)
+
+    for path, error in index.stats.errors:
+        print(f"{path}: {error}", file=sys.stderr)
+
+    print(
+        f"Indexed {index.file_count} files in {len(index)} archives "
+        f"({index.stats})",
+        file=sys.stderr,
+    )
+
 
+def find_files(names: list[str], index_path: Path, use_groups=False) -> bool:
+    """
+    Print the archives containing files with the given names
 
-def print_info(ice_path: Path, humanize=False):
+    :return: True if any file was found
+    """
+    index = ArchiveIndex.load(index_path)
+
+    found = False
+    for name in names:
+        for file in index.find(name):
+            prefix = f"group{file.group + 1}/" if use_groups else ""
+            print(f"{file.archive}: {prefix}{file.name}")
+            found = True
+
+    return found
+
+
+def print_info(ice_path: Path, humanize=False, index_path: Optional[Path] = None):
     """Print ICE file metadata and file list"""
 
     def formatsize(num):
         return naturalsize(num) if humanize else num
 
-    ice = IceFile.read(ice_path)
-
-    print(f"Version: {ice.header.version}")
-    print(f"Flags:   0x{ice.meta.flags:04x}")
-    print(f"Size:    {formatsize(ice.meta.file_size)}")
-
-    if ice.group1_files:
-        print_group_info("Group 1:", ice.group1_files, humanize)
+    if entry := _lookup_index(index_path, ice_path):
+        print(f"Version: {entry.version}")
+        print(f"Flags:   0x{entry.flags:04x}")
+        print(f"Size:    {formatsize(entry.size)}")
+
+        for group in range(2):
+            if files := entry.group_files(group):
+                print_group_info(
+                    f"Group {group + 1}:",
+                    [(file.name, file.size) for file in files],
+                    humanize,
+                )
+        return
+
+    with MappedIceFile(ice_path) as ice:
+        print(f"Version: {ice.header.version}")
+        print(f"Flags:   0x{ice.meta.flags:04x}")
+        print(f"Size:    {formatsize(ice.meta.file_size)}")
+
+        if ice.group1_files:
+            print_group_info(
+                "Group 1:", [(f.name, len(f.data)) for f in ice.group1_files], humanize
+            )
 
-    if ice.group2_files:
-        print_group_info("Group 2:", ice.group2_files, humanize)
+        if ice.group2_files:
+            print_group_info(
+                "Group 2:", [(f.name, len(f.data)) for f in ice.group2_files], humanize
+            )
 
 
-def print_group_info(header: str, files: Iterable[DataFile], humanize=False):
-    """Print files in a file group"""
+def print_group_info(header: str, files: list[Tuple[str, int]], humanize=False):
+    """Print the (name, size) of each file in a file group"""
 
     def formatsize(num):
         return naturalsize(num) if humanize else num
 
-    column_width = max(len(f.name) for f in files)
+    column_width = max(len(name) for name, _ in files)
 
     print()
     print(header)
-    for file in files:
-        print(f"  {file.name.ljust(column_width)}  {formatsize(len(file.data))}")
+    for name, size in files:
+        print(f"  {name.ljust(column_width)}  {formatsize(size)}")
 
 
-def print_file_list(ice_path: Path, use_groups=False):
+def print_file_list(
+    ice_path: Path, use_groups=False, index_path: Optional[Path] = None
+):
     """Print files contained in an ICE archive"""
 
     group1_prefix = "group1/" if use_groups else ""
     group2_prefix = "group2/" if use_groups else ""
 
-    ice = IceFile.read(ice_path)
+    if entry := _lookup_index(index_path, ice_path):
+        for file in entry.files:
+            print((group2_prefix if file.group else group1_prefix) + file.name)
+        return
 
-    for file in ice.group1_files:
-        print(group1_prefix + file.name)
+    with MappedIceFile(ice_path) as ice:
+        for file in ice.group1_files:
+            print(group1_prefix + file.name)
 
-    for file in ice.group2_files:
-        print(group2_prefix + file.name)
+        for file in ice.group2_files:
+            print(group2_prefix + file.name)
@@ -2,18 +2,28 @@
 Compression options
 """
 from dataclasses import dataclass
+import re
 from typing import Literal, Optional
 
 
 DEFAULT_COMPRESS_LEVEL = 3
 
+# Slowest compression speed, in MB/s, that automatic selection picks by default
+DEFAULT_AUTO_BUDGET = 5.0
+
 
 @dataclass
 class CompressOptions:
-    """Selects the type of compression to use"""
+    """
+    Selects the type of compression to use
+
+    In "auto" mode, each group is either stored or compressed with the Kraken level
+    that makes it smallest while compressing at least `budget` MB/s.
+    """
 
-    mode: Literal["none", "kraken", "prs"] = "kraken"
+    mode: Literal["none", "kraken", "prs", "auto"] = "kraken"
     level: int = DEFAULT_COMPRESS_LEVEL
+    budget: float = DEFAULT_AUTO_BUDGET
 
     @staticmethod
     def parse(value: Optional[str | int]):
@@ -38,9 +48,18 @@ class CompressOptions:
             case "prs":
                 return CompressOptions("prs")
 
+            case "auto":
+                return CompressOptions("auto")
+
+            case str() if match := re.fullmatch(r"auto:([0-9]+(?:\.[0-9]*)?)", value):
+                return CompressOptions("auto", budget=float(match[1]))
+
+            case str() if match := re.fullmatch("prs:([0-9])", value):
+                return CompressOptions("prs", int(match[1]))
+
             case _:
                 raise TypeError(
-                    f'Compression mode must be 0-9, "kraken", "prs", or "none". Got "{value}"'
+                    f'Compression mode must be 0-9, "kraken", "prs", "prs:0-9", "auto", "auto:<MB/s>", or "none". Got "{value}"'
                 )
 
     def __bool__(self):
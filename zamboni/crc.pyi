@@ -4,5 +4,60 @@ CRC32
 
 # pylint: disable=unused-argument
 
+from typing import Tuple
+
 def crc32(*data: bytes) -> int:
     """Calculate a CRC32 of one or more buffers"""
+
+def crc32_update(data: bytes, initial: int) -> int:
+    """Continue a CRC32 with more data"""
+
+def crc32_combine(crc_a: int, crc_b: int, size_b: int) -> int:
+    """
+    Calculate the CRC32 of two buffers joined together without reading them again
+
+    :param crc_a: CRC32 of the first buffer
+    :param crc_b: CRC32 of the second buffer
+    :param size_b: Size of the second buffer in bytes
+    :raises ValueError: The size is negative
+    """
+
+class Crc32:
+    """Incrementally calculated CRC32"""
+
+    def __init__(self, initial: int = 0):
+        """
+        :param initial: CRC32 of the data so far, or 0 to start a new checksum
+        """
+
+    @property
+    def size(self) -> int:
+        """Number of bytes checksummed so far"""
+
+    def update(self, data: bytes):
+        """Add data to the checksum"""
+
+    def combine(self, crc: int, size: int):
+        """
+        Add data that was checksummed separately, e.g. on another thread
+
+        :param crc: CRC32 of the data
+        :param size: Size of the data in bytes
+        :raises ValueError: The size is negative
+        """
+
+    def digest(self) -> int:
+        """Get the checksum of the data so far"""
+
+def _stats() -> dict[str, Tuple[int, int, int]]:
+    """
+    Get this module's stage counters as {stage: (calls, bytes, nanoseconds)}
+
+    Use zamboni.stats() instead, which combines the counters of every module.
+    """
+
+def _set_stats_enabled(enabled: bool):
+    """Turn the stage counters of this module on or off"""
+
+def _reset_stats():
+    """Set the stage counters of this module to zero"""
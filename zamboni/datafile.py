@@ -89,7 +89,7 @@ class DataFile:
     """ICE archive data file"""
 
     name: str
-    data: bytes
+    data: bytes | memoryview
     header: Optional[DataFileHeader] = None
 
     @staticmethod
@@ -6,9 +6,7 @@ from dataclasses import dataclass
 from struct import unpack_from, pack
 from typing import Tuple
 
-import numpy as np
-from Crypto.Cipher import Blowfish
-
+from . import blowfish
 from . import floatage
 from .crc import crc32
 from .util import int32_to_uint32
@@ -29,29 +27,31 @@ def floatage_decrypt(data: bytes, key: bytes):
     return floatage.decrypt(data, key_uint)
 
 
-def _endian_swap(data: bytes):
-    return np.frombuffer(data, dtype=np.uint32).byteswap().tobytes()
+def floatage_decrypt_inplace(data: bytearray | memoryview, key: bytes):
+    """Same as floatage_decrypt(), but modifies a writable buffer in place"""
+    key_uint = unpack_from("<I", key)[0]
+    floatage.decrypt_inplace(data, key_uint)
 
 
-def blowfish_decrypt(data: bytes, key: bytes):
+def blowfish_decrypt(data: bytes, key: bytes) -> bytes:
     """Decrypt data using blowfish cipher"""
-    dlen = len(data)
-    split = dlen - (dlen % Blowfish.block_size)
-    blocks, remainder = data[0:split], data[split:]
+    # TODO: is leaving the remainder unmodified correct or a bug in the C# code?
+    return blowfish.decrypt(data, key)
 
-    cipher = Blowfish.new(key, Blowfish.MODE_ECB)
 
-    # TODO: can we avoid needing to swap byte order back and forth here?
-    # Can't find any way to set the cipher to little endian.
-    decrypted = _endian_swap(cipher.decrypt(_endian_swap(blocks)))
-
-    # TODO: is leaving the remainder unmodified correct or a bug in the C# code?
-    return decrypted + remainder
+def blowfish_decrypt_inplace(data: bytearray | memoryview, key: bytes):
+    """Same as blowfish_decrypt(), but modifies a writable buffer in place"""
+    blowfish.decrypt_inplace(data, key)
 
 
 def blowfish_encrypt(data: bytes, key: bytes) -> bytes:
     """Encrypt data using blowfish cipher"""
-    raise NotImplementedError()
+    return blowfish.encrypt(data, key)
+
+
+def blowfish_encrypt_inplace(data: bytearray | memoryview, key: bytes):
+    """Same as blowfish_encrypt(), but modifies a writable buffer in place"""
+    blowfish.encrypt_inplace(data, key)
 
 
 def get_blowfish_keys(magic_numbers: bytes, file_size: int) -> BlowfishKeys:
@@ -4,5 +4,23 @@ I don't know what this does
 
 # pylint: disable=unused-argument
 
+from typing import Tuple
+
 def decrypt(data: bytes, key: int) -> bytes:
     """Some sort of preprocessing done before blowfish encryption?"""
+
+def decrypt_inplace(data: bytearray | memoryview, key: int) -> None:
+    """Same as decrypt(), but modifies a writable buffer in place"""
+
+def _stats() -> dict[str, Tuple[int, int, int]]:
+    """
+    Get this module's stage counters as {stage: (calls, bytes, nanoseconds)}
+
+    Use zamboni.stats() instead, which combines the counters of every module.
+    """
+
+def _set_stats_enabled(enabled: bool):
+    """Turn the stage counters of this module on or off"""
+
+def _reset_stats():
+    """Set the stage counters of this module to zero"""
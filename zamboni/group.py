@@ -3,20 +3,26 @@ Data file groups
 """
 
 from dataclasses import dataclass
-from io import BytesIO
 import struct
-from typing import BinaryIO, ClassVar, Iterable, Optional, Tuple
-import os
-
-import numpy as np
+import threading
+import time
+from typing import BinaryIO, ClassVar, Iterable, Optional, Sequence, Tuple
 
+from .cache import CompressionCache
 from .compression import CompressOptions
 from .crc import crc32
+from . import native
 from . import ooz
 from . import prs
 from .datafile import DataFile
-from .encrpytion import blowfish_decrypt, blowfish_encrypt, floatage_decrypt
-from .util import is_headerless_file, is_nifl, read_struct
+from .encrpytion import (
+    blowfish_decrypt_inplace,
+    blowfish_encrypt_inplace,
+    floatage_decrypt_inplace,
+)
+from .util import read_struct
+# PRS data in ICE archives is XORed with this value
+PRS_XOR_KEY = 0x95
 
 
 @dataclass
@@ -64,175 +70,451 @@ def get_group_header(data: bytes, file_count: int, original_size: int):
 
 def extract_group(
     header: GroupHeader,
-    stream: BinaryIO,
+    stream: BinaryIO | bytes | memoryview,
     compression: CompressOptions,
     encrypted=False,
     keys: Optional[Tuple[bytes, bytes]] = None,
     second_pass_threshold=0,
     v3_decrypt=False,
 ) -> bytes:
-    """Read a file group from a stream, decrypting and decompressing as necessary"""
+    """
+    Read a file group from a stream or buffer, decrypting and decompressing as necessary
+
+    A buffer must start with the stored group data. It is not copied.
+    """
     if header.stored_size == 0:
         return bytes()
 
-    data = stream.read(header.stored_size)
     if encrypted:
         assert keys is not None
-        data = decrypt_group(
-            data,
-            keys=keys,
-            second_pass_threshold=second_pass_threshold,
-            v3_decrypt=v3_decrypt,
-        )
 
-    if header.compressed_size:
-        data = decompress_group(data, header.original_size, options=compression)
+    return native.extract_group(
+        _read_stored(header, stream),
+        original_size=header.original_size,
+        compressed_size=header.compressed_size,
+        mode=compression.mode,
+        keys=keys if encrypted else None,
+        second_pass_threshold=second_pass_threshold,
+        v3_decrypt=v3_decrypt,
+    )
+
+
+def extract_files(
+    header: GroupHeader,
+    stream: BinaryIO | bytes | memoryview,
+    names: Iterable[str],
+    compression: CompressOptions,
+    encrypted=False,
+    keys: Optional[Tuple[bytes, bytes]] = None,
+    second_pass_threshold=0,
+    v3_decrypt=False,
+) -> list[DataFile]:
+    """
+    Read only the files with the given names from a file group
+
+    Other files are skipped without being copied, and PRS and uncompressed groups are
+    only decoded as far as the last file found. Each name is extracted once.
+    """
+    names = list(names)
+    if header.stored_size == 0 or not names:
+        return []
+
+    if encrypted:
+        assert keys is not None
+
+    files = native.extract_files(
+        _read_stored(header, stream),
+        original_size=header.original_size,
+        compressed_size=header.compressed_size,
+        file_count=header.file_count,
+        names=names,
+        mode=compression.mode,
+        keys=keys if encrypted else None,
+        second_pass_threshold=second_pass_threshold,
+        v3_decrypt=v3_decrypt,
+    )
+
+    return [DataFile(name=name, data=data) for name, data in files]
+
+
+def _read_stored(header: GroupHeader, stream: BinaryIO | bytes | memoryview):
+    """Get the stored data of a group from the start of a stream or buffer"""
+    if isinstance(stream, (bytes, bytearray, memoryview)):
+        data = stream[: header.stored_size]
+    else:
+        data = stream.read(header.stored_size)
+
+    if len(data) < header.stored_size:
+        raise ValueError("Group data is truncated")
 
     return data
 
 
+@dataclass
+class StoredGroup:
+    """A file group as stored in an ICE archive"""
+
+    header: GroupHeader
+    # Offset of the stored group data from the start of the archive
+    offset: int
+    compression: CompressOptions
+    encrypted: bool = False
+    keys: Optional[Tuple[bytes, bytes]] = None
+    second_pass_threshold: int = 0
+    v3_decrypt: bool = False
+
+    def extract(self, stream: BinaryIO | bytes | memoryview) -> bytes:
+        """Read the group from a stream or buffer, decrypting and decompressing as necessary"""
+        return extract_group(
+            self.header,
+            stream,
+            compression=self.compression,
+            encrypted=self.encrypted,
+            keys=self.keys,
+            second_pass_threshold=self.second_pass_threshold,
+            v3_decrypt=self.v3_decrypt,
+        )
+
+    def extract_files(
+        self, stream: BinaryIO | bytes | memoryview, names: Iterable[str]
+    ) -> list[DataFile]:
+        """Read only the files with the given names from a stream or buffer"""
+        return extract_files(
+            self.header,
+            stream,
+            names,
+            compression=self.compression,
+            encrypted=self.encrypted,
+            keys=self.keys,
+            second_pass_threshold=self.second_pass_threshold,
+            v3_decrypt=self.v3_decrypt,
+        )
+
+
+@dataclass
+class SourceGroup:
+    """
+    A file group as it was stored in the archive it was read from
+
+    Keeps the stored data along with the files the group held, so a group whose files
+    have not changed can be written again without recompressing it.
+    """
+
+    stored: StoredGroup
+    data: bytes
+    files: list[Tuple[str, bytes | memoryview]]
+
+    @staticmethod
+    def snapshot(stored: StoredGroup, data: bytes, files: list[DataFile]):
+        """Record the stored data and current contents of a group"""
+        return SourceGroup(stored, data, [(file.name, file.data) for file in files])
+
+    def can_reuse(
+        self, files: list[DataFile], compression: CompressOptions, encrypt: bool
+    ) -> bool:
+        """
+        Can the stored data be written in place of a group built from the given files?
+
+        Groups that are (or should be) encrypted are never reused, and the stored
+        compression mode must match. The compression level is not known, so a reused
+        group keeps the level it was originally compressed with.
+        """
+        if encrypt or self.stored.encrypted:
+            return False
+
+        header = self.stored.header
+        mode = self.stored.compression.mode if header.compressed_size else "none"
+        if compression.mode == "auto":
+            if mode not in ("kraken", "none"):
+                return False
+        elif mode != compression.mode:
+            return False
+
+        if len(files) != len(self.files):
+            return False
+
+        return all(
+            file.name == name and (file.data is data or file.data == data)
+            for file, (name, data) in zip(files, self.files)
+        )
+
+
 def decrypt_group(
-    data: bytes, keys: Tuple[bytes, bytes], second_pass_threshold=0, v3_decrypt=False
-) -> bytes:
-    """Decrypt a file group"""
+    data: bytearray,
+    keys: Tuple[bytes, bytes],
+    second_pass_threshold=0,
+    v3_decrypt=False,
+) -> bytearray:
+    """Decrypt a file group in place"""
     key1, key2 = keys
 
     if not v3_decrypt:
-        data = floatage_decrypt(data, key1)
+        floatage_decrypt_inplace(data, key1)
 
     # The last 12 bytes of the file don't match the C# Zamboni implementation.
     # Is that a bug here or a bug there?
-    data = blowfish_decrypt(data, key1)
+    blowfish_decrypt_inplace(data, key1)
 
     if not v3_decrypt and len(data) <= second_pass_threshold:
-        data = blowfish_decrypt(data, key2)
+        blowfish_decrypt_inplace(data, key2)
 
     return data
 
 
 def encrypt_group(
     data: bytes, keys: Tuple[bytes, bytes], second_pass_threshold=0
-) -> bytes:
+) -> bytearray:
     """Encrypt a file group"""
     key1, key2 = keys
+    data = bytearray(data)
 
     if len(data) <= second_pass_threshold:
-        data = blowfish_encrypt(data, key2)
+        blowfish_encrypt_inplace(data, key2)
 
-    data = blowfish_encrypt(data, key1)
-    return floatage_decrypt(data, key1)
+    blowfish_encrypt_inplace(data, key1)
+    floatage_decrypt_inplace(data, key1)
+    return data
 
 
-def compress_group(data: bytes, options: CompressOptions = CompressOptions()) -> bytes:
-    """Compress a file group"""
-    if not data:
-        return data
+_compressors = threading.local()
 
-    match options.mode:
-        case "none":
-            return data
-
-        case "kraken":
-            return ooz.kraken_compress(data, level=options.level)
 
-        case "prs":
-            data = prs.compress(data)
-            return (np.frombuffer(data, dtype=np.uint8) ^ 0x95).tobytes()
+def get_compressor(
+    options: CompressOptions,
+) -> ooz.KrakenCompressor | prs.Compressor:
+    """
+    Get the calling thread's compressor for file groups with the given options
 
-        case _:
-            raise NotImplementedError()
+    Compressors keep their buffers between calls, which saves allocating them again
+    for every group. Each thread gets its own, since a compressor can only be used by
+    one thread at a time.
+    """
+    compressors: dict[Tuple[str, int], ooz.KrakenCompressor | prs.Compressor]
+    compressors = _compressors.__dict__.setdefault("compressors", {})
 
+    key = (options.mode, options.level)
+    if compressor := compressors.get(key):
+        return compressor
 
-def decompress_group(
-    data: bytes, out_size: int, options: CompressOptions = CompressOptions()
-) -> bytes:
-    """Decompress a file group"""
     match options.mode:
-        case "none":
-            return data
-
         case "kraken":
-            return ooz.kraken_decompress(data, out_size)
+            compressor = ooz.KrakenCompressor(level=options.level)
 
         case "prs":
-            data = np.frombuffer(data, dtype=np.uint8) ^ 0x95
-            return prs.decompress(data, out_size)
+            compressor = prs.Compressor(level=options.level, xor_key=PRS_XOR_KEY)
 
         case _:
             raise NotImplementedError()
 
+    compressors[key] = compressor
+    return compressor
+
+
+# Kraken levels tried by automatic selection, fastest first
+AUTO_LEVELS = (1, 4, 6, 8)
+# Groups are sampled in pieces of this size from their start, middle and end
+AUTO_SAMPLE_SIZE = 0x40000
+AUTO_SAMPLE_COUNT = 3
+# Store groups that compress by less than this fraction, such as DDS or OGG data
+AUTO_MIN_SAVING = 0.03
+# Prefer a faster level when a slower one saves less than this fraction more
+AUTO_MIN_GAIN = 0.02
 
-def split_group(header: GroupHeader, data: bytes) -> list[bytes]:
-    """Split a file group into individual files"""
+
+def choose_compression(data: bytes, budget: float) -> CompressOptions:
+    """
+    Choose how to compress a file group by compressing samples of it
+
+    :param data: Group data
+    :param budget: Slowest compression speed to accept, in MB/s
+    :return: Options to store the group or to compress it with Kraken
+    """
     if not data:
-        return []
+        return CompressOptions("none")
+
+    view = memoryview(data)
+    if len(data) <= AUTO_SAMPLE_SIZE * AUTO_SAMPLE_COUNT:
+        samples = [view]
+    else:
+        step = (len(data) - AUTO_SAMPLE_SIZE) // (AUTO_SAMPLE_COUNT - 1)
+        samples = [
+            view[i * step : i * step + AUTO_SAMPLE_SIZE]
+            for i in range(AUTO_SAMPLE_COUNT)
+        ]
+
+    sample_size = sum(len(sample) for sample in samples)
+    best: Optional[Tuple[int, int]] = None
+
+    for level in AUTO_LEVELS:
+        compressor = get_compressor(CompressOptions("kraken", level))
+
+        start = time.perf_counter()
+        size = sum(len(compressor.compress(sample)) for sample in samples)
+        elapsed = time.perf_counter() - start
+
+        # Levels only get slower, so stop at the first one that is over budget. The
+        # fastest level is still used if nothing is within budget.
+        within_budget = elapsed <= 0 or sample_size / elapsed / 1e6 >= budget
+
+        if best is None:
+            # If the fastest level barely helps, the slower ones won't either
+            if size > sample_size * (1 - AUTO_MIN_SAVING):
+                return CompressOptions("none")
+            best = (level, size)
+        elif within_budget and size < best[1] * (1 - AUTO_MIN_GAIN):
+            best = (level, size)
+
+        if not within_budget:
+            break
 
-    if is_nifl(data):
-        return _split_headerless_nifl(header, data)
+    return CompressOptions("kraken", best[0])
 
-    if is_headerless_file(data):
-        return _split_headerless_file(header, data)
 
-    return _split_normal_group(header, data)
+def compress_group(
+    data: bytes,
+    options: CompressOptions = CompressOptions(),
+    cache: Optional[CompressionCache] = None,
+    dictionary: bytes = b"",
+) -> bytes:
+    """
+    Compress a file group
+
+    :param data: Group data
+    :param options: Compression options
+    :param cache: Cache of previously compressed groups to use and fill
+    :param dictionary: Data to prime the PRS match window with, such as a trained
+        corpus or the other group of the archive. This helps small groups that
+        resemble it, but the group can then only be decompressed with the same
+        dictionary, which the game and other ICE readers don't support. The cache
+        is not used with a dictionary.
+    """
+    if not data or options.mode == "none":
+        return data
 
+    if dictionary:
+        if options.mode != "prs":
+            raise ValueError("Dictionaries are only supported with PRS compression")
 
-_INT32 = struct.Struct("i")
+        return get_compressor(options).compress(data, dictionary=dictionary)
 
+    if cache and (compressed := cache.get(data, options)) is not None:
+        return compressed
 
-def _split_headerless_nifl(header: GroupHeader, data: bytes):
-    files: list[DataFile] = []
-    stream = BytesIO(data)
+    if options.mode == "auto":
+        choice = choose_compression(data, options.budget)
+        compressed = compress_group(data, choice)
+    else:
+        compressed = get_compressor(options).compress(data)
 
-    for i in range(header.file_count):
-        start = stream.tell()
+    if cache:
+        cache.put(data, options, compressed)
+
+    return compressed
 
-        if stream.read(4) != b"NIFL":
-            # Nameless file for remaining file data
-            stream.seek(start, os.SEEK_SET)
-            files.append(DataFile.from_stream(stream, file_index=i))
-            break
 
-        stream.seek(16, os.SEEK_CUR)
-        size = read_struct(_INT32, stream)[0]
+def compress_groups(
+    groups: Sequence[bytes],
+    options: CompressOptions = CompressOptions(),
+    threads=1,
+    cache: Optional[CompressionCache] = None,
+) -> list[bytes]:
+    """
+    Compress several file groups at once
 
-        stream.seek(size - 0x10, os.SEEK_CUR)
-        nof0_size = read_struct(_INT32, stream)[0] + 8
+    :param groups: Data for each group
+    :param options: Compression options
+    :param threads: Number of threads to use, or 0 for one per CPU. Large Kraken
+        groups are split into chunks to use more than one thread per group.
+    :param cache: Cache of previously compressed groups. Only groups that miss the
+        cache are compressed, and they are added to it afterwards.
+    """
+    if not cache or options.mode == "none":
+        return _compress_groups(groups, options, threads)
 
-        # Add padding bytes
-        nof0_size += 0x10 - (nof0_size % 0x10)
+    results = [cache.get(data, options) if data else data for data in groups]
+    missing = [i for i, result in enumerate(results) if result is None]
 
-        # Add NOF0 size and NEND bytes
-        size += nof0_size + 0x10
+    compressed = _compress_groups([groups[i] for i in missing], options, threads)
 
-        stream.seek(start, os.SEEK_SET)
-        files.append(DataFile.from_bytes(stream.read(size), file_index=i))
+    for i, data in zip(missing, compressed):
+        cache.put(groups[i], options, data)
+        results[i] = data
 
-    return files
+    return results
 
 
-def _split_headerless_file(header: GroupHeader, data: bytes):
-    if header.file_count != 1:
-        raise ValueError(
-            f"Expected a single nameless file but header lists {header.file_count} files."
+def _compress_groups(
+    groups: Sequence[bytes], options: CompressOptions, threads: int
+) -> list[bytes]:
+    if options.mode != "auto":
+        return native.compress_groups(
+            groups, mode=options.mode, level=options.level, threads=threads
         )
-    return [data]
 
+    # Compress the groups that chose the same options together
+    chosen: dict[Tuple[str, int], list[int]] = {}
+    for i, data in enumerate(groups):
+        choice = choose_compression(data, options.budget)
+        chosen.setdefault((choice.mode, choice.level), []).append(i)
 
-def _split_normal_group(header: GroupHeader, data: bytes):
-    files: list[bytes] = []
-    stream = BytesIO(data)
+    results: list[bytes] = [b""] * len(groups)
+    for (mode, level), indices in chosen.items():
+        compressed = native.compress_groups(
+            [groups[i] for i in indices], mode=mode, level=level, threads=threads
+        )
+        for i, data in zip(indices, compressed):
+            results[i] = data
+
+    return results
 
-    for i in range(header.file_count):
-        files.append(DataFile.from_stream(stream, file_index=i))
 
-    return files
+def decompress_group(
+    data: bytes,
+    out_size: int,
+    options: CompressOptions = CompressOptions(),
+    dictionary: bytes = b"",
+) -> bytes:
+    """
+    Decompress a file group
 
+    :param data: Compressed group data
+    :param out_size: Size of the decompressed group
+    :param options: Compression options the group was compressed with
+    :param dictionary: Dictionary the group was compressed with, if any
+    """
+    if dictionary and options.mode != "prs":
+        raise ValueError("Dictionaries are only supported with PRS compression")
 
-def combine_group(files: Iterable[DataFile]):
-    """Combine data files into a file group"""
-    data = BytesIO()
+    match options.mode:
+        case "none":
+            return data
+
+        case "kraken":
+            return ooz.kraken_decompress(data, out_size)
+
+        case "prs":
+            return prs.decompress(
+                data, out_size, xor_key=PRS_XOR_KEY, dictionary=dictionary
+            )
+
+        case _:
+            raise NotImplementedError()
 
-    for file in files:
-        file.write(data, include_header=True)
 
-    return data.getvalue()
+def split_group(header: GroupHeader, data: bytes | memoryview) -> list[DataFile]:
+    """
+    Split a file group into individual files
+
+    The data of each file is a memoryview into the group data rather than a copy.
+    """
+    view = memoryview(data)
+
+    return [
+        DataFile(name=name, data=view[offset : offset + size])
+        for name, offset, size in native.split_group(view, file_count=header.file_count)
+    ]
+
+
+def combine_group(files: Iterable[DataFile]) -> bytes:
+    """Combine data files into a file group"""
+    return native.combine_group([(file.name, file.data) for file in files])
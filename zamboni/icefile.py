@@ -7,16 +7,18 @@ from io import BytesIO
 import os
 from pathlib import Path
 import struct
-from typing import BinaryIO, ClassVar, Optional, Tuple
+from typing import BinaryIO, ClassVar, Iterable, Optional, Tuple
 
+from .cache import CompressionCache
 from .compression import CompressOptions
-from .crc import crc32
+from .crc import crc32, crc32_combine
 from .datafile import DataFile
 from .group import (
     GroupHeader,
+    SourceGroup,
+    StoredGroup,
     combine_group,
-    compress_group,
-    extract_group,
+    compress_groups,
     get_group_header,
     split_group,
 )
@@ -111,6 +113,15 @@ class IceFileMetadata:
         self.flags = set_flag(self.flags, IceFlags.KRAKEN_COMPRESSED, value)
 
 
+@dataclass
+class IceFileLayout:
+    """Metadata of an ICE archive and where its file groups are stored"""
+
+    meta: IceFileMetadata
+    group1: StoredGroup
+    group2: StoredGroup
+
+
 @dataclass
 class IceFile:
     """ICE archive file"""
@@ -121,18 +132,66 @@ class IceFile:
     group2_header: GroupHeader = None
     group1_files: list[DataFile] = field(default_factory=list)
     group2_files: list[DataFile] = field(default_factory=list)
+    # Groups as stored in the archive this was read from, used by incremental writes
+    group1_source: Optional[SourceGroup] = field(
+        default=None, repr=False, compare=False
+    )
+    group2_source: Optional[SourceGroup] = field(
+        default=None, repr=False, compare=False
+    )
 
     @staticmethod
-    def read(stream: BinaryIO | Path | str) -> "IceFile":
-        """Read an ICE archive from a stream or file"""
+    def read(stream: BinaryIO | Path | str, keep_source=False) -> "IceFile":
+        """
+        Read an ICE archive from a stream or file
+
+        :param keep_source: Also keep the groups as they are stored, so that an
+            incremental write can copy the ones whose files are unchanged. This holds
+            the compressed data in memory for as long as the object lives.
+        """
         if isinstance(stream, (Path, str)):
             with open(stream, "rb") as file:
-                return IceFile.read(file)
+                return IceFile.read(file, keep_source)
 
         header = IceFileHeader.read(stream)
         file_type = IceFile.get_file_type(header.version)
 
-        return file_type.read_after_header(header, stream)
+        return file_type.read_after_header(header, stream, keep_source)
+
+    @staticmethod
+    def extract(
+        stream: BinaryIO | Path | str, names: Iterable[str]
+    ) -> Tuple[list[DataFile], list[DataFile]]:
+        """
+        Read only the files with the given names from an ICE archive
+
+        Group 2 is only decoded if some of the names were not found in group 1, and
+        the other files in a group are skipped without being copied. Each name is
+        extracted once, from its first occurrence.
+
+        :param stream: Seekable stream or file path
+        :param names: Names of the files to extract
+        :return: Files found in group 1 and group 2
+        """
+        if isinstance(stream, (Path, str)):
+            with open(stream, "rb") as file:
+                return IceFile.extract(file, names)
+
+        header = IceFileHeader.read(stream)
+        layout = IceFile.get_file_type(header.version).read_layout(header, stream)
+
+        remaining = list(dict.fromkeys(names))
+        found: list[list[DataFile]] = []
+
+        for group in (layout.group1, layout.group2):
+            stream.seek(group.offset)
+            files = group.extract_files(stream, remaining)
+
+            extracted = {file.name for file in files}
+            remaining = [name for name in remaining if name not in extracted]
+            found.append(files)
+
+        return found[0], found[1]
 
     @staticmethod
     def get_file_type(version: int) -> type["IceFile"]:
@@ -149,7 +208,51 @@ class IceFile:
         return IceFile
 
     @classmethod
-    def read_after_header(cls, header: IceFileHeader, stream: BinaryIO):
+    def read_after_header(
+        cls, header: IceFileHeader, stream: BinaryIO, keep_source=False
+    ) -> "IceFile":
+        """
+        Read the data following the IceFileHeader
+
+        :param keep_source: Keep the stored groups for incremental writes
+        """
+        layout = cls.read_layout(header, stream)
+
+        group1_stored = stream.read(layout.group1.header.stored_size)
+        group2_stored = stream.read(layout.group2.header.stored_size)
+        group1_files = split_group(
+            layout.group1.header, layout.group1.extract(group1_stored)
+        )
+        group2_files = split_group(
+            layout.group2.header, layout.group2.extract(group2_stored)
+        )
+
+        ice = cls(
+            header=header,
+            meta=layout.meta,
+            group1_header=layout.group1.header,
+            group2_header=layout.group2.header,
+            group1_files=group1_files,
+            group2_files=group2_files,
+        )
+
+        if keep_source:
+            ice.group1_source = SourceGroup.snapshot(
+                layout.group1, group1_stored, group1_files
+            )
+            ice.group2_source = SourceGroup.snapshot(
+                layout.group2, group2_stored, group2_files
+            )
+
+        return ice
+
+    @classmethod
+    def read_layout(cls, header: IceFileHeader, stream: BinaryIO) -> "IceFileLayout":
+        """
+        Read the headers following the IceFileHeader
+
+        This leaves the stream at the start of the group 1 data.
+        """
         raise NotImplementedError()
 
     def write(
@@ -157,16 +260,52 @@ class IceFile:
         stream: BinaryIO | Path | str,
         compression=CompressOptions(),
         encrypt=False,
+        threads=1,
+        incremental=False,
+        cache: Optional[CompressionCache] = None,
     ):
-        """Write an ICE archive to a stream or file"""
+        """
+        Write an ICE archive to a stream or file
+
+        :param stream: Output stream or file path
+        :param compression: Compression options
+        :param encrypt: Encrypt the archive?
+        :param threads: Number of threads to compress with, or 0 for one per CPU
+        :param incremental: Copy the stored data of groups whose files are unchanged
+            since the archive was read instead of compressing them again
+        :param cache: Cache of compressed groups to reuse and add to
+        """
         if isinstance(stream, (Path, str)):
             with open(stream, "wb") as file:
-                self.write(file, compression=compression, encrypt=encrypt)
+                self.write(
+                    file,
+                    compression=compression,
+                    encrypt=encrypt,
+                    threads=threads,
+                    incremental=incremental,
+                    cache=cache,
+                )
+            return
 
         self.header.write(stream)
-        self._write(stream, compression=compression, encrypt=encrypt)
+        self._write(
+            stream,
+            compression=compression,
+            encrypt=encrypt,
+            threads=threads,
+            incremental=incremental,
+            cache=cache,
+        )
 
-    def _write(self, stream: BinaryIO, compression: CompressOptions, encrypt: bool):
+    def _write(
+        self,
+        stream: BinaryIO,
+        compression: CompressOptions,
+        encrypt: bool,
+        threads: int,
+        incremental: bool,
+        cache: Optional[CompressionCache],
+    ):
         raise NotImplementedError()
 
 
@@ -195,8 +334,8 @@ class IceFileV3(IceFile):
             return IceFileV3.GroupInfo(*read_struct(IceFileV3.GroupInfo.FORMAT, stream))
 
     @classmethod
-    def read_after_header(cls, header: IceFileHeader, stream: BinaryIO) -> "IceFileV3":
-        """Read the data following the IceFileHeader"""
+    def read_layout(cls, header: IceFileHeader, stream: BinaryIO) -> IceFileLayout:
+        """Read the headers following the IceFileHeader"""
         assert header.version == 3
 
         group1_header = GroupHeader.read(stream)
@@ -211,36 +350,24 @@ class IceFileV3(IceFile):
         keys = IceFileV3._get_keys(group1_header, group2_header, group_info, meta)
         compression = CompressOptions("kraken" if meta.kraken_compressed else "prs")
 
-        group1_data = extract_group(
-            group1_header,
-            stream,
-            compression=compression,
-            encrypted=meta.encrypted,
-            keys=keys,
-            second_pass_threshold=IceFileV3.SECOND_PASS_THRESHOLD,
-            v3_decrypt=True,
-        )
-
-        group2_data = extract_group(
-            group2_header,
-            stream,
-            compression=compression,
-            encrypted=meta.encrypted,
-            keys=keys,
-            second_pass_threshold=IceFileV3.SECOND_PASS_THRESHOLD,
-            v3_decrypt=True,
-        )
+        def stored_group(group_header: GroupHeader, offset: int):
+            return StoredGroup(
+                header=group_header,
+                offset=offset,
+                compression=compression,
+                encrypted=meta.encrypted,
+                keys=keys,
+                second_pass_threshold=IceFileV3.SECOND_PASS_THRESHOLD,
+                v3_decrypt=True,
+            )
 
-        group1_files = split_group(group1_header, group1_data)
-        group2_files = split_group(group2_header, group2_data)
+        group1_offset = stream.tell()
+        group2_offset = group1_offset + group1_header.stored_size
 
-        return IceFileV3(
-            header=header,
+        return IceFileLayout(
             meta=meta,
-            group1_header=group1_header,
-            group2_header=group2_header,
-            group1_files=group1_files,
-            group2_files=group2_files,
+            group1=stored_group(group1_header, group1_offset),
+            group2=stored_group(group2_header, group2_offset),
         )
 
     @staticmethod
@@ -266,7 +393,15 @@ class IceFileV3(IceFile):
 
         return None
 
-    def _write(self, stream: BinaryIO, compression: CompressOptions, encrypt: bool):
+    def _write(
+        self,
+        stream: BinaryIO,
+        compression: CompressOptions,
+        encrypt: bool,
+        threads: int,
+        incremental: bool,
+        cache: Optional[CompressionCache],
+    ):
         raise NotImplementedError()
 
 
@@ -282,8 +417,8 @@ class IceFileV4(IceFile):
         self.header.version = 4
 
     @classmethod
-    def read_after_header(cls, header: IceFileHeader, stream: BinaryIO) -> "IceFileV4":
-        """Read the data following the IceFileHeader"""
+    def read_layout(cls, header: IceFileHeader, stream: BinaryIO) -> IceFileLayout:
+        """Read the headers following the IceFileHeader"""
         assert header.version == 4
 
         meta = IceFileMetadata.read(stream)
@@ -302,63 +437,75 @@ class IceFileV4(IceFile):
 
         compression = CompressOptions("kraken" if meta.kraken_compressed else "prs")
 
-        group1_data = extract_group(
-            group1_header,
-            stream,
-            compression=compression,
-            encrypted=meta.encrypted,
-            keys=keys.group1_keys,
-            second_pass_threshold=IceFileV4.SECOND_PASS_THRESHOLD,
-        )
-
-        group2_data = extract_group(
-            group2_header,
-            stream,
-            compression=compression,
-            encrypted=meta.encrypted,
-            keys=keys.group2_keys,
-            second_pass_threshold=IceFileV4.SECOND_PASS_THRESHOLD,
-        )
+        def stored_group(
+            group_header: GroupHeader, offset: int, group_keys: Tuple[bytes, bytes]
+        ):
+            return StoredGroup(
+                header=group_header,
+                offset=offset,
+                compression=compression,
+                encrypted=meta.encrypted,
+                keys=group_keys,
+                second_pass_threshold=IceFileV4.SECOND_PASS_THRESHOLD,
+            )
 
-        group1_files = split_group(group1_header, group1_data)
-        group2_files = split_group(group2_header, group2_data)
+        group1_offset = stream.tell()
+        group2_offset = group1_offset + group1_header.stored_size
 
-        return IceFileV4(
-            header=header,
+        return IceFileLayout(
             meta=meta,
-            group1_header=group1_header,
-            group2_header=group2_header,
-            group1_files=group1_files,
-            group2_files=group2_files,
+            group1=stored_group(group1_header, group1_offset, keys.group1_keys),
+            group2=stored_group(group2_header, group2_offset, keys.group2_keys),
         )
 
-    def _write(self, stream: BinaryIO, compression: CompressOptions, encrypt: bool):
+    def _write(
+        self,
+        stream: BinaryIO,
+        compression: CompressOptions,
+        encrypt: bool,
+        threads: int,
+        incremental: bool,
+        cache: Optional[CompressionCache],
+    ):
         self.meta.encrypted = encrypt
-        self.meta.kraken_compressed = compression.mode == "kraken"
-
-        group1_data = combine_group(self.group1_files)
-        group2_data = combine_group(self.group2_files)
-        group1_original_size = len(group1_data)
-        group2_original_size = len(group2_data)
+        # Automatic compression only chooses between Kraken levels and storing groups
+        self.meta.kraken_compressed = compression.mode in ("kraken", "auto")
+
+        groups = [self.group1_files, self.group2_files]
+        sources = [self.group1_source, self.group2_source]
+        stored: list[Optional[bytes]] = [None, None]
+        headers: list[Optional[GroupHeader]] = [None, None]
+        checksums = [0, 0]
+
+        if incremental:
+            for i, source in enumerate(sources):
+                if source and source.can_reuse(groups[i], compression, encrypt):
+                    stored[i] = source.data
+                    headers[i] = source.stored.header
+                    # Don't rely on checksums in archives written by other tools
+                    checksums[i] = crc32(source.data)
+
+        rebuild = [i for i, data in enumerate(stored) if data is None]
+        combined = [combine_group(groups[i]) for i in rebuild]
+        compressed = compress_groups(
+            combined, options=compression, threads=threads, cache=cache
+        )
 
-        group1_data = compress_group(group1_data, options=compression)
-        group2_data = compress_group(group2_data, options=compression)
+        for i, original, data in zip(rebuild, combined, compressed):
+            stored[i] = data
+            headers[i] = get_group_header(
+                data=data, file_count=len(groups[i]), original_size=len(original)
+            )
+            checksums[i] = headers[i].crc32
 
-        self.group1_header = get_group_header(
-            data=group1_data,
-            file_count=len(self.group1_files),
-            original_size=group1_original_size,
-        )
-        self.group2_header = get_group_header(
-            data=group2_data,
-            file_count=len(self.group2_files),
-            original_size=group2_original_size,
-        )
+        group1_data, group2_data = stored
+        self.group1_header, self.group2_header = headers
 
         self.meta.file_size = (
             IceFileV4.HEADER_SIZE + len(group1_data) + len(group2_data)
         )
-        self.meta.crc32 = crc32(group1_data, group2_data)
+        # Each group was already checksummed, so the data doesn't need to be read again
+        self.meta.crc32 = crc32_combine(checksums[0], checksums[1], len(group2_data))
         self.meta.write(stream)
 
         if self.meta.encrypted:
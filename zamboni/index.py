@@ -0,0 +1,373 @@
+"""
+Persistent index of the files in many ICE archives
+"""
+import bisect
+from dataclasses import dataclass, field
+import os
+from pathlib import Path
+import re
+import struct
+import tempfile
+from typing import ClassVar, Iterator, Optional, Tuple
+
+from . import native
+from .batch import find_archives
+
+# (group, name, offset, size, crc32)
+_FileRecord = Tuple[int, str, int, int, int]
+
+
+@dataclass
+class IndexedFile:
+    """A data file listed in an archive index"""
+
+    archive: Path
+    # Index of the group the file is in (0 or 1)
+    group: int
+    name: str
+    # Location of the file data in the extracted group, not including its header
+    offset: int
+    size: int
+    crc32: int
+
+
+@dataclass
+class IndexedArchive:
+    """An archive listed in an archive index"""
+
+    path: Path
+    mtime_ns: int
+    size: int
+    # 0 if the archive could not be read when it was indexed
+    version: int
+    flags: int
+    files: list[IndexedFile] = field(default_factory=list)
+
+    def is_current(self) -> bool:
+        """Is the archive unchanged since it was indexed?"""
+        try:
+            stat = self.path.stat()
+        except FileNotFoundError:
+            return False
+
+        return stat.st_mtime_ns == self.mtime_ns and stat.st_size == self.size
+
+    def group_files(self, group: int) -> list[IndexedFile]:
+        """Files in one of the groups"""
+        return [file for file in self.files if file.group == group]
+
+
+@dataclass
+class IndexStats:
+    """What the last build of an index did"""
+
+    indexed: int = 0
+    reused: int = 0
+    removed: int = 0
+    # (archive, error message) for each archive that could not be read
+    errors: list[Tuple[Path, str]] = field(default_factory=list)
+
+    def __str__(self):
+        return (
+            f"{self.indexed} indexed, {self.reused} unchanged, "
+            f"{self.removed} removed, {len(self.errors)} failed"
+        )
+
+
+class ArchiveIndex:
+    """
+    Index of the files in every ICE archive under a directory
+
+    The index is a compact binary table of archives (path, modified time, size) and
+    the files in each of their groups (name, offset, size, CRC-32). Lookups work on the
+    table directly: names are matched with one regular expression search over all of
+    them, so nothing is decoded except the matches.
+
+    Building an index from a previous one only reads archives whose modified time or
+    size changed.
+    """
+
+    MAGIC: ClassVar[bytes] = b"ZIDX"
+    VERSION: ClassVar[int] = 1
+
+    # magic, version, archive count, file count, root size, paths size, names size
+    HEADER: ClassVar[struct.Struct] = struct.Struct("<4sIIIIII4x")
+    # mtime_ns, size, version, flags, path offset, path size, first file
+    ARCHIVE: ClassVar[struct.Struct] = struct.Struct("<qQIIIII")
+    # archive, group, name offset, offset, size, crc32
+    FILE: ClassVar[struct.Struct] = struct.Struct("<IIIIII")
+    FILE_FIELDS: ClassVar[int] = 6
+
+    def __init__(self, data: bytes):
+        """
+        Use ArchiveIndex.load() or ArchiveIndex.build() instead
+
+        :param data: Serialized index
+        """
+        if len(data) < self.HEADER.size:
+            raise ValueError("Not an archive index")
+
+        (
+            magic,
+            version,
+            self._archive_count,
+            self._file_count,
+            root_size,
+            paths_size,
+            names_size,
+        ) = self.HEADER.unpack_from(data)
+
+        if magic != self.MAGIC:
+            raise ValueError("Not an archive index")
+        if version != self.VERSION:
+            raise ValueError(f"Unsupported archive index version {version}")
+
+        archives_start = self.HEADER.size
+        files_start = archives_start + self._archive_count * self.ARCHIVE.size
+        root_start = files_start + self._file_count * self.FILE.size
+        paths_start = root_start + root_size
+        names_start = paths_start + paths_size
+
+        if len(data) != names_start + names_size:
+            raise ValueError("Archive index is truncated")
+
+        view = memoryview(data)
+        self._archives = view[archives_start:files_start]
+        # Each file is FILE_FIELDS integers, so they can be read without unpacking
+        self._files = view[files_start:root_start].cast("I")
+        self._paths = data[paths_start:names_start]
+        self._names = data[names_start:]
+
+        self.root = Path(os.fsdecode(data[root_start:paths_start]))
+        self.stats = IndexStats()
+        self._data = data
+
+    def __len__(self):
+        return self._archive_count
+
+    @property
+    def file_count(self) -> int:
+        """Number of files in all the archives"""
+        return self._file_count
+
+    @staticmethod
+    def load(path: Path | str) -> "ArchiveIndex":
+        """Read an index from a file"""
+        return ArchiveIndex(Path(path).read_bytes())
+
+    def save(self, path: Path | str):
+        """Write the index to a file"""
+        path = Path(path)
+
+        # Write to a temporary file first so a failed write doesn't lose the old index
+        fd, temp_path = tempfile.mkstemp(dir=path.parent, suffix=".tmp")
+        try:
+            with os.fdopen(fd, "wb") as file:
+                file.write(self._data)
+            os.replace(temp_path, path)
+        except BaseException:
+            os.unlink(temp_path)
+            raise
+
+    @staticmethod
+    def build(
+        root: Path | str, previous: Optional["ArchiveIndex"] = None, jobs=0
+    ) -> "ArchiveIndex":
+        """
+        Index every archive under a directory
+
+        :param root: Directory to search for archives recursively
+        :param previous: Earlier index of the same directory. Archives whose modified
+            time and size have not changed are copied from it instead of being read.
+        :param jobs: Number of threads to read archives with, or 0 for one per CPU
+        """
+        root = Path(root).resolve()
+        stats = IndexStats()
+
+        known: dict[str, int] = {}
+        if previous is not None and previous.root == root:
+            known = {previous._path(i): i for i in range(len(previous))}
+
+        records: dict[str, Tuple[int, int, int, int, list[_FileRecord]]] = {}
+        pending: list[Tuple[str, os.stat_result]] = []
+
+        for path, _ in find_archives([root]):
+            rel = path.relative_to(root).as_posix()
+            stat = path.stat()
+
+            i = known.pop(rel, None)
+            if i is not None:
+                mtime_ns, size, version, flags = previous._archive_info(i)
+                if mtime_ns == stat.st_mtime_ns and size == stat.st_size:
+                    files = previous._records(i)
+                    records[rel] = (mtime_ns, size, version, flags, files)
+                    stats.reused += 1
+                    continue
+
+            pending.append((rel, stat))
+
+        results = native.index_many([root / rel for rel, _ in pending], threads=jobs)
+
+        for (rel, stat), (version, flags, files, error) in zip(pending, results):
+            if error is not None:
+                # Record the failure so the archive isn't read again until it changes
+                stats.errors.append((root / rel, error))
+                version = 0
+
+            records[rel] = (stat.st_mtime_ns, stat.st_size, version, flags, files)
+            stats.indexed += 1
+
+        stats.removed = len(known)
+
+        index = ArchiveIndex(ArchiveIndex._serialize(root, records))
+        index.stats = stats
+        return index
+
+    def get(self, path: Path | str) -> Optional[IndexedArchive]:
+        """Get the entry for an archive, or None if it is not in the index"""
+        try:
+            rel = Path(path).resolve().relative_to(self.root).as_posix()
+        except ValueError:
+            return None
+
+        # Archives are sorted by path
+        i = bisect.bisect_left(range(len(self)), rel, key=self._path)
+        if i == len(self) or self._path(i) != rel:
+            return None
+
+        return self._archive(i)
+
+    def archives(self) -> Iterator[IndexedArchive]:
+        """Iterate over every archive in the index"""
+        return (self._archive(i) for i in range(len(self)))
+
+    def find(self, pattern: str) -> list[IndexedFile]:
+        """
+        Find files by name
+
+        :param pattern: File name, which may contain "*" and "?" wildcards
+        :return: Every matching file, ordered by archive path
+        """
+        regex = re.compile(b"\0(" + _glob_to_regex(pattern) + b")(?=\0)")
+        fields = self.FILE_FIELDS
+
+        # Names are stored in file order, so bisecting finds the file for a name
+        def name_offset(i: int):
+            return self._files[i * fields + 2]
+
+        files = range(self._file_count)
+        matches = []
+        archive_paths: dict[int, Path] = {}
+
+        for match in regex.finditer(self._names):
+            i = bisect.bisect_left(files, match.start(1), key=name_offset)
+
+            archive = self._files[i * fields]
+            if archive not in archive_paths:
+                archive_paths[archive] = self.root / self._path(archive)
+
+            matches.append(self._file(i, archive_paths[archive]))
+
+        return matches
+
+    def _unpack_archive(self, archive: int):
+        return self.ARCHIVE.unpack_from(self._archives, archive * self.ARCHIVE.size)
+
+    def _path(self, archive: int) -> str:
+        offset, size = self._unpack_archive(archive)[4:6]
+        return os.fsdecode(self._paths[offset : offset + size])
+
+    def _archive_info(self, archive: int) -> Tuple[int, int, int, int]:
+        return self._unpack_archive(archive)[:4]
+
+    def _file_range(self, archive: int) -> range:
+        first = self._unpack_archive(archive)[6]
+        if archive + 1 < len(self):
+            end = self._unpack_archive(archive + 1)[6]
+        else:
+            end = self._file_count
+        return range(first, end)
+
+    def _name(self, offset: int) -> str:
+        return self._names[offset : self._names.index(b"\0", offset)].decode()
+
+    def _record(self, i: int) -> _FileRecord:
+        start = i * self.FILE_FIELDS
+        fields = self._files[start : start + self.FILE_FIELDS]
+        _, group, name_offset, offset, size, crc32 = fields
+        return (group, self._name(name_offset), offset, size, crc32)
+
+    def _file(self, i: int, archive_path: Path) -> IndexedFile:
+        return IndexedFile(archive_path, *self._record(i))
+
+    def _records(self, archive: int) -> list[_FileRecord]:
+        return [self._record(i) for i in self._file_range(archive)]
+
+    def _archive(self, archive: int) -> IndexedArchive:
+        path = self.root / self._path(archive)
+        mtime_ns, size, version, flags = self._archive_info(archive)
+
+        return IndexedArchive(
+            path=path,
+            mtime_ns=mtime_ns,
+            size=size,
+            version=version,
+            flags=flags,
+            files=[self._file(i, path) for i in self._file_range(archive)],
+        )
+
+    @staticmethod
+    def _serialize(
+        root: Path, records: dict[str, Tuple[int, int, int, int, list[_FileRecord]]]
+    ) -> bytes:
+        archives = bytearray()
+        files = bytearray()
+        paths = bytearray()
+        # Every name is surrounded by NULs so that find() can match whole names
+        names = bytearray(b"\0")
+        file_count = 0
+
+        for archive, rel in enumerate(sorted(records)):
+            mtime_ns, size, version, flags, archive_files = records[rel]
+
+            # Paths are stored as the file system gives them, so that names that are not
+            # valid UTF-8 survive
+            path = os.fsencode(rel)
+            archives += ArchiveIndex.ARCHIVE.pack(
+                mtime_ns, size, version, flags, len(paths), len(path), file_count
+            )
+            paths += path
+
+            for group, name, offset, file_size, crc32 in archive_files:
+                files += ArchiveIndex.FILE.pack(
+                    archive, group, len(names), offset, file_size, crc32
+                )
+                names += name.encode() + b"\0"
+                file_count += 1
+
+        root_bytes = os.fsencode(root)
+        header = ArchiveIndex.HEADER.pack(
+            ArchiveIndex.MAGIC,
+            ArchiveIndex.VERSION,
+            len(records),
+            file_count,
+            len(root_bytes),
+            len(paths),
+            len(names),
+        )
+
+        return b"".join([header, archives, files, root_bytes, paths, names])
+
+
+def _glob_to_regex(pattern: str) -> bytes:
+    """Convert a file name with "*" and "?" wildcards to a regular expression"""
+    parts = []
+    for char in pattern:
+        if char == "*":
+            parts.append(b"[^\0]*")
+        elif char == "?":
+            parts.append(b"[^\0]")
+        else:
+            parts.append(re.escape(char.encode()))
+
+    return b"".join(parts)
@@ -0,0 +1,87 @@
+"""
+Memory-mapped ICE archive reader
+"""
+import mmap
+from pathlib import Path
+from typing import Optional
+
+from .datafile import DataFile
+from .group import GroupHeader, StoredGroup, split_group
+from .icefile import IceFile, IceFileHeader, IceFileMetadata
+
+
+class MappedIceFile:
+    """
+    ICE archive that is read through a memory map
+
+    Only the archive headers are parsed when the file is opened. Each file group is
+    decrypted, decompressed and split the first time one of its files is accessed.
+    File data is a memoryview into the extracted group, so it stays valid after the
+    archive is closed.
+    """
+
+    header: IceFileHeader
+    meta: IceFileMetadata
+
+    def __init__(self, path: Path | str):
+        with open(path, "rb") as file:
+            self._map = mmap.mmap(file.fileno(), 0, access=mmap.ACCESS_READ)
+
+        try:
+            self.header = IceFileHeader.read(self._map)
+            file_type = IceFile.get_file_type(self.header.version)
+            layout = file_type.read_layout(self.header, self._map)
+        except BaseException:
+            self._map.close()
+            raise
+
+        self.meta = layout.meta
+        self._groups = (layout.group1, layout.group2)
+        self._files: list[Optional[list[DataFile]]] = [None, None]
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def close(self):
+        """Unmap the archive. Files that were already extracted remain valid."""
+        self._map.close()
+
+    @property
+    def group1_header(self) -> GroupHeader:
+        """Header for file group 1"""
+        return self._groups[0].header
+
+    @property
+    def group2_header(self) -> GroupHeader:
+        """Header for file group 2"""
+        return self._groups[1].header
+
+    @property
+    def group1_files(self) -> list[DataFile]:
+        """Files in group 1. Extracts the group on first access."""
+        return self._get_files(0)
+
+    @property
+    def group2_files(self) -> list[DataFile]:
+        """Files in group 2. Extracts the group on first access."""
+        return self._get_files(1)
+
+    def _get_files(self, index: int) -> list[DataFile]:
+        files = self._files[index]
+
+        if files is None:
+            group = self._groups[index]
+            files = split_group(group.header, self._extract(group))
+            self._files[index] = files
+
+        return files
+
+    def _extract(self, group: StoredGroup) -> bytes:
+        end = group.offset + group.header.stored_size
+
+        # Release the views before returning so the map can be closed
+        with memoryview(self._map) as view, view[group.offset : end] as stored:
+            return group.extract(stored)
@@ -0,0 +1,197 @@
+"""
+Native implementations of the ICE archive pipeline
+
+These run every stage for a group in one call without holding the GIL.
+"""
+
+# pylint: disable=unused-argument
+
+from os import PathLike
+from typing import Optional, Sequence, Tuple
+
+def extract_group(
+    data: bytes,
+    original_size: int,
+    compressed_size: int,
+    mode: str = "kraken",
+    keys: Optional[Tuple[bytes, bytes]] = None,
+    second_pass_threshold: int = 0,
+    v3_decrypt: bool = False,
+) -> bytes:
+    """
+    Decrypt and decompress a file group as stored in an ICE archive
+
+    :param data: Stored group data
+    :param original_size: Size of the group after decompression
+    :param compressed_size: Size of the compressed group, or 0 if it is not compressed
+    :param mode: Compression mode ("none", "kraken" or "prs")
+    :param keys: Blowfish keys if the group is encrypted
+    :param second_pass_threshold: Groups up to this size are decrypted a second time with the second key
+    :param v3_decrypt: Decrypt with the ICE v3 scheme (no floatage or second pass)
+    :raises ValueError:
+    """
+
+def extract_files(
+    data: bytes,
+    original_size: int,
+    compressed_size: int,
+    file_count: int,
+    names: Sequence[str],
+    mode: str = "kraken",
+    keys: Optional[Tuple[bytes, bytes]] = None,
+    second_pass_threshold: int = 0,
+    v3_decrypt: bool = False,
+) -> list[Tuple[str, bytes]]:
+    """
+    Extract only the data files with the given names from a file group
+
+    Other files are skipped using the sizes in their headers, and decoding stops once
+    every name has been found. Kraken groups are still decompressed in full.
+
+    :param data: Stored group data
+    :param original_size: Size of the group after decompression
+    :param compressed_size: Size of the compressed group, or 0 if it is not compressed
+    :param file_count: Number of files listed in the group header
+    :param names: Names of the files to extract. Each is extracted from its first occurrence.
+    :param mode: Compression mode ("none", "kraken" or "prs")
+    :param keys: Blowfish keys if the group is encrypted
+    :param second_pass_threshold: Groups up to this size are decrypted a second time with the second key
+    :param v3_decrypt: Decrypt with the ICE v3 scheme (no floatage or second pass)
+    :return: (name, data) of each file found, in the order they are stored
+    :raises ValueError:
+    """
+
+def split_group(data: bytes, file_count: int) -> list[Tuple[str, int, int]]:
+    """
+    Find the data files in an extracted file group
+
+    :param data: Extracted group data
+    :param file_count: Number of files listed in the group header
+    :return: (name, offset, size) of the data of each file
+    :raises ValueError:
+    """
+
+def combine_group(files: Sequence[Tuple[str, bytes]]) -> bytes:
+    """
+    Build a file group from data files
+
+    The group is allocated once at its final size, and each file is written with its
+    data file header and padding.
+
+    :param files: (name, data) for each file
+    """
+
+def compress_groups(
+    groups: Sequence[bytes],
+    mode: str = "kraken",
+    level: int = 3,
+    threads: int = 1,
+) -> list[bytes]:
+    """
+    Compress file groups for an ICE archive
+
+    :param groups: Data for each group
+    :param mode: Compression mode ("none", "kraken" or "prs")
+    :param level: Compression level
+    :param threads: Number of threads to use, or 0 for one per CPU. With more than one thread,
+        large Kraken groups are split into chunks that are compressed independently.
+    :raises ValueError:
+    """
+
+def write_v4(
+    path: PathLike,
+    group1: Sequence[Tuple[str, PathLike]],
+    group2: Sequence[Tuple[str, PathLike]],
+    mode: str = "kraken",
+    level: int = 3,
+    threads: int = 1,
+) -> None:
+    """
+    Write an unencrypted version 4 ICE archive from files on disk
+
+    Each group is built from the files as it is compressed and written, so only one
+    batch of it is held in memory: a few Kraken chunks, or a whole PRS group. The
+    headers are filled in at the end.
+
+    :param path: Output file, which is removed if writing fails
+    :param group1: (name, path) of each file in group 1
+    :param group2: (name, path) of each file in group 2
+    :param mode: Compression mode ("none", "kraken" or "prs")
+    :param level: Compression level
+    :param threads: Number of threads to compress Kraken chunks with, or 0 for one per CPU
+    :raises ValueError:
+    :raises OSError:
+    """
+
+def unpack_many(
+    jobs: Sequence[Tuple[PathLike, PathLike]],
+    use_groups: bool = False,
+    dump_raw_data: bool = False,
+    threads: int = 0,
+    io_threads: int = 0,
+    queue_size: int = 256 << 20,
+) -> list[Tuple[list[str], Optional[str], Optional[dict[str, Tuple[int, int, int]]]]]:
+    """
+    Unpack ICE archives on a work-stealing thread pool
+
+    With I/O threads, the archives are read in order ahead of the decoding threads and
+    their files are written behind them instead, through queues that each hold at most
+    queue_size bytes.
+
+    :param jobs: (archive path, output directory) for each archive
+    :param use_groups: Write files to "group1" and "group2" subdirectories
+    :param dump_raw_data: Do not strip ICE file headers
+    :param threads: Number of decoding threads to use, or 0 for one per CPU
+    :param io_threads: Number of threads that read and write, or 0 to read and write
+        on the decoding threads
+    :param queue_size: Most bytes held in each queue between the stages
+    :return: (files written, error message or None, stage counters) for each archive.
+        The stage counters are like _stats(), but only for that archive, and are None
+        unless counting is enabled.
+    """
+
+def verify_many(
+    paths: Sequence[PathLike],
+    threads: int = 0,
+) -> list[Tuple[list[str], Optional[dict[str, Tuple[int, int, int]]]]]:
+    """
+    Check ICE archives on a work-stealing thread pool without extracting their files
+
+    Each archive is memory-mapped, and every group is checksummed and decompressed
+    into a reused buffer.
+
+    :param paths: Archive paths
+    :param threads: Number of threads to use, or 0 for one per CPU
+    :return: (problems found, stage counters) for each archive. There are no
+        problems if it is intact. The stage counters are like unpack_many()'s.
+    """
+
+def index_many(
+    paths: Sequence[PathLike],
+    threads: int = 0,
+) -> list[Tuple[int, int, list[Tuple[int, str, int, int, int]], Optional[str]]]:
+    """
+    List the files in ICE archives on a work-stealing thread pool
+
+    Each archive is memory-mapped and its groups are decoded in pieces. File data is
+    checksummed and then discarded.
+
+    :param paths: Archive paths
+    :param threads: Number of threads to use, or 0 for one per CPU
+    :return: (version, flags, files, error message or None) for each archive. Each file
+        is (group index, name, offset in the extracted group, size, CRC-32). Archives
+        that fail list no files.
+    """
+
+def _stats() -> dict[str, Tuple[int, int, int]]:
+    """
+    Get this module's stage counters as {stage: (calls, bytes, nanoseconds)}
+
+    Use zamboni.stats() instead, which combines the counters of every module.
+    """
+
+def _set_stats_enabled(enabled: bool):
+    """Turn the stage counters of this module on or off"""
+
+def _reset_stats():
+    """Set the stage counters of this module to zero"""
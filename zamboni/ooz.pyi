@@ -4,6 +4,11 @@ Oodle compression
 
 # pylint: disable=unused-argument
 
+from typing import Tuple
+
+SAFE_SPACE: int
+"""Number of bytes past the end of the output that decompression may overwrite"""
+
 def kraken_compress(data: bytes, level=3) -> bytes:
     """
     Compress data to Kraken format
@@ -21,3 +26,49 @@ def kraken_decompress(data: bytes, out_size: int) -> bytes:
     :param out_size: Expected size of the output data
     :raises ValueError:
     """
+
+def kraken_decompress_into(data: bytes, out: bytearray | memoryview, out_size: int) -> int:
+    """
+    Decompress data from Kraken format into an existing buffer
+
+    :param data: Data to decompress
+    :param out: Writable buffer to decompress into. Must be at least out_size + SAFE_SPACE bytes.
+    :param out_size: Expected size of the output data
+    :return: Number of bytes written
+    :raises ValueError:
+    """
+
+class KrakenCompressor:
+    """
+    Compresses many buffers to Kraken format at the same level
+
+    The output buffer is kept between calls. A compressor can only be used by one
+    thread at a time, so keep one per thread.
+    """
+
+    def __init__(self, level=4):
+        """
+        :param level: Compression level. 0 = none, 9 = max
+        """
+
+    def compress(self, data: bytes) -> bytes:
+        """
+        Compress data to Kraken format
+
+        :param data: Data to compress
+        :raises ValueError:
+        :raises RuntimeError: The compressor is in use by another thread
+        """
+
+def _stats() -> dict[str, Tuple[int, int, int]]:
+    """
+    Get this module's stage counters as {stage: (calls, bytes, nanoseconds)}
+
+    Use zamboni.stats() instead, which combines the counters of every module.
+    """
+
+def _set_stats_enabled(enabled: bool):
+    """Turn the stage counters of this module on or off"""
+
+def _reset_stats():
+    """Set the stage counters of this module to zero"""
@@ -5,6 +5,8 @@ from pathlib import Path
 import re
 from typing import BinaryIO, Iterable, Optional, Type, TypeVar
 
+from . import native
+from .cache import CompressionCache
 from .compression import CompressOptions
 from .datafile import DataFile
 from .icefile import IceFile, IceFileV4
@@ -32,6 +34,9 @@ def pack(
     file_type: _T | int = IceFileV4,
     compression=CompressOptions(),
     encrypt=False,
+    threads=1,
+    cache: Optional[CompressionCache] = None,
+    streaming=False,
 ):
     """
     Pack files into an ICE archive
@@ -44,7 +49,25 @@ def pack(
     :param file_type: IceFile subclass or version number of the format to use
     :param compression: Compression options
     :param encrypt: Encrypt the archive?
+    :param threads: Number of threads to compress with, or 0 for one per CPU
+    :param cache: Cache of compressed groups to reuse and add to
+    :param streaming: Read each file as it is compressed and write the compressed data
+        as it is produced, instead of holding every file in memory. Only writes
+        unencrypted version 4 archives to a file path, and the cache is not used.
     """
+    if streaming:
+        return _pack_streaming(
+            file,
+            paths=paths,
+            group1_files=group1_files,
+            exclude_files=exclude_files,
+            file_type=file_type,
+            compression=compression,
+            encrypt=encrypt,
+            threads=threads,
+            cache=cache,
+        )
+
     if isinstance(file, (str, Path)):
         with open(file, mode="wb") as f:
             return pack(
@@ -55,6 +78,8 @@ def pack(
                 file_type=file_type,
                 compression=compression,
                 encrypt=encrypt,
+                threads=threads,
+                cache=cache,
             )
 
     group1_files = parse_file_list(group1_files or [])
@@ -74,7 +99,57 @@ def pack(
     ice.group1_files = [DataFile(name=f.name, data=f.read_bytes()) for f in group1]
     ice.group2_files = [DataFile(name=f.name, data=f.read_bytes()) for f in group2]
 
-    ice.write(file, compression=compression, encrypt=encrypt)
+    ice.write(
+        file,
+        compression=compression,
+        encrypt=encrypt,
+        threads=threads,
+        cache=cache,
+    )
+
+    return group1, group2
+
+
+def _pack_streaming(
+    file: str | Path | BinaryIO,
+    paths: Path | Iterable[Path],
+    group1_files: Optional[Iterable[str]],
+    exclude_files: Optional[Iterable[str]],
+    file_type: _T | int,
+    compression: CompressOptions,
+    encrypt: bool,
+    threads: int,
+    cache: Optional[CompressionCache],
+):
+    if not isinstance(file, (str, Path)):
+        raise ValueError("Streaming needs an output file path")
+    if file_type not in (4, IceFileV4):
+        raise ValueError("Streaming only writes version 4 archives")
+    if encrypt:
+        # TODO: write encryption keys
+        raise NotImplementedError()
+    if compression.mode == "auto":
+        raise ValueError("Streaming does not support automatic compression")
+    if cache is not None:
+        raise ValueError("Streaming does not use the compression cache")
+
+    group1, group2 = group_files(
+        paths,
+        group1_files=parse_file_list(group1_files or []),
+        exclude_files=parse_file_list(exclude_files or []),
+    )
+
+    if not group1 and not group2:
+        raise ValueError("No files to pack")
+
+    native.write_v4(
+        file,
+        group1=[(f.name, f) for f in group1],
+        group2=[(f.name, f) for f in group2],
+        mode=compression.mode,
+        level=compression.level,
+        threads=threads,
+    )
 
     return group1, group2
 
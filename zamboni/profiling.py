@@ -0,0 +1,137 @@
+"""
+Timing counters for the stages of reading and writing archives
+"""
+from dataclasses import dataclass, field
+from typing import Optional, Tuple
+
+from . import blowfish, crc, floatage, native, ooz, prs
+
+# Each extension module has its own copy of the counters, which are read through its
+# private functions
+# pylint: disable=protected-access
+_MODULES = [blowfish, crc, floatage, native, ooz, prs]
+
+
+@dataclass
+class StageStats:
+    """Time spent in one stage and how much data it worked on"""
+
+    calls: int = 0
+    # Uncompressed bytes, so compression and decompression speeds compare directly
+    bytes: int = 0
+    nanoseconds: int = 0
+
+    @property
+    def seconds(self) -> float:
+        """Time spent in the stage in seconds"""
+        return self.nanoseconds / 1e9
+
+    @property
+    def throughput(self) -> float:
+        """MB/s of data worked on, or 0 if no time was spent"""
+        if not self.nanoseconds:
+            return 0
+
+        return self.bytes * 1e3 / self.nanoseconds
+
+    def __add__(self, other: "StageStats") -> "StageStats":
+        return StageStats(
+            self.calls + other.calls,
+            self.bytes + other.bytes,
+            self.nanoseconds + other.nanoseconds,
+        )
+
+    def __sub__(self, other: "StageStats") -> "StageStats":
+        return StageStats(
+            self.calls - other.calls,
+            self.bytes - other.bytes,
+            self.nanoseconds - other.nanoseconds,
+        )
+
+
+@dataclass
+class Stats:
+    """
+    Counters for every stage of the native code
+
+    Stages do not overlap on one thread, but stages run on several threads at once
+    add up to more than the time that passed.
+    """
+
+    stages: dict[str, StageStats] = field(default_factory=dict)
+
+    @staticmethod
+    def from_counters(counters: dict[str, Tuple[int, int, int]]) -> "Stats":
+        """Create from the {stage: (calls, bytes, nanoseconds)} that modules return"""
+        return Stats({name: StageStats(*values) for name, values in counters.items()})
+
+    @property
+    def seconds(self) -> float:
+        """Time spent in all the stages in seconds"""
+        return sum(stage.seconds for stage in self.stages.values())
+
+    def __add__(self, other: "Stats") -> "Stats":
+        return Stats(
+            {
+                name: self.stages.get(name, StageStats())
+                + other.stages.get(name, StageStats())
+                for name in self.stages | other.stages
+            }
+        )
+
+    def __sub__(self, other: "Stats") -> "Stats":
+        return Stats(
+            {
+                name: stage - other.stages.get(name, StageStats())
+                for name, stage in self.stages.items()
+            }
+        )
+
+    def format(self, wall_seconds: Optional[float] = None) -> str:
+        """
+        Make a table of the stages that ran
+
+        :param wall_seconds: Time that passed, to show how much of it was spent outside
+            the native stages
+        """
+        lines = [f"{'stage':<18} {'calls':>8} {'MB':>10} {'seconds':>9} {'MB/s':>9}"]
+
+        for name, stage in self.stages.items():
+            if stage.calls:
+                lines.append(
+                    f"{name:<18} {stage.calls:>8} {stage.bytes / 1e6:>10.2f} "
+                    f"{stage.seconds:>9.3f} {stage.throughput:>9.1f}"
+                )
+
+        lines.append(f"{'total':<18} {'':>8} {'':>10} {self.seconds:>9.3f}")
+        if wall_seconds is not None:
+            lines.append(f"{'wall':<18} {'':>8} {'':>10} {wall_seconds:>9.3f}")
+
+        return "\n".join(lines)
+
+    def __str__(self):
+        return self.format()
+
+
+def stats() -> Stats:
+    """Get the counters of every stage since they were last reset"""
+    total = Stats()
+    for module in _MODULES:
+        total += Stats.from_counters(module._stats())
+    return total
+
+
+def enable_stats(enabled=True):
+    """
+    Turn the stage counters on or off
+
+    They are off by default, since timing every call has a small cost.
+    """
+    for module in _MODULES:
+        module._set_stats_enabled(enabled)
+
+
+def reset_stats():
+    """Set every stage counter to zero"""
+    for module in _MODULES:
+        module._reset_stats()
@@ -4,14 +4,93 @@ Sega PRS compression
 
 # pylint: disable=unused-argument
 
-def compress(data: bytes) -> bytes:
-    """Compress data to Sega PRS format"""
+from typing import Tuple
 
-def decompress(data: bytes, out_size: int) -> bytes:
+MAX_DICTIONARY_SIZE: int
+"""Number of bytes at the end of a dictionary that compressed data can refer to"""
+
+def compress(
+    data: bytes, level=3, search_depth=0, xor_key=0, dictionary: bytes = b""
+) -> bytes:
+    """
+    Compress data to Sega PRS format
+
+    :param data: Data to compress
+    :param level: Compression level. 0-2 = greedy (fast), 3-6 = lazy, 7-9 = optimal (smallest)
+        Higher levels usually compress better, but not always. 7-9 can be very slow on data
+        with long runs of one value, e.g. 13-35 s for 2 MB of zero padded records.
+    :param search_depth: Number of match candidates to try per byte, or 0 to use the level's default.
+        Lower is faster, higher compresses better.
+    :param xor_key: Every byte of the compressed data is XORed with this value
+    :param dictionary: Data the input is compressed as if it followed, so references can reach into it.
+        Only the last MAX_DICTIONARY_SIZE bytes are used. The output can only be decompressed with the same
+        dictionary.
+    :raises ValueError:
+    """
+
+def decompress(data: bytes, out_size: int, xor_key=0, dictionary: bytes = b"") -> bytes:
     """
     Decompress data from Sega PRS format
 
     :param data: Data to decompress
     :param out_size: Expected size of the output data
+    :param xor_key: Every byte of the compressed data is XORed with this value before decoding
+    :param dictionary: Dictionary the data was compressed with, if any
     :raises ValueError:
     """
+
+def decompress_into(
+    data: bytes, out: bytearray | memoryview, xor_key=0, dictionary: bytes = b""
+) -> int:
+    """
+    Decompress data from Sega PRS format into an existing buffer
+
+    :param data: Data to decompress
+    :param out: Writable buffer to decompress into. Its size is the expected size of the output data.
+    :param xor_key: Every byte of the compressed data is XORed with this value before decoding
+    :param dictionary: Dictionary the data was compressed with, if any
+    :return: Number of bytes decoded. If this is less than len(out), the rest of out is unspecified.
+    :raises ValueError:
+    """
+
+class Compressor:
+    """
+    Compresses many buffers with the same options
+
+    The match finder tables and output buffer are kept between calls, which makes
+    compressing many small buffers much faster than calling compress() for each one.
+    A compressor can only be used by one thread at a time, so keep one per thread.
+    """
+
+    def __init__(self, level=3, search_depth=0, xor_key=0):
+        """
+        :param level: Compression level. 0-2 = greedy (fast), 3-6 = lazy, 7-9 = optimal (smallest)
+            Higher levels usually compress better, but not always. 7-9 can be very slow on
+            data with long runs of one value, e.g. 13-35 s for 2 MB of zero padded records.
+        :param search_depth: Number of match candidates to try per byte, or 0 to use the level's default.
+        :param xor_key: Every byte of the compressed data is XORed with this value
+        :raises ValueError:
+        """
+
+    def compress(self, data: bytes, dictionary: bytes = b"") -> bytes:
+        """
+        Compress data to Sega PRS format
+
+        :param data: Data to compress
+        :param dictionary: Data to prime the match window with. See compress().
+        :raises ValueError:
+        :raises RuntimeError: The compressor is in use by another thread
+        """
+
+def _stats() -> dict[str, Tuple[int, int, int]]:
+    """
+    Get this module's stage counters as {stage: (calls, bytes, nanoseconds)}
+
+    Use zamboni.stats() instead, which combines the counters of every module.
+    """
+
+def _set_stats_enabled(enabled: bool):
+    """Turn the stage counters of this module on or off"""
+
+def _reset_stats():
+    """Set the stage counters of this module to zero"""
@@ -1,13 +1,15 @@
 from pathlib import Path
 from typing import Any, Generator, Iterable, Optional, overload
 
+from . import native
 from .datafile import DataFile
 from .icefile import IceFile
+from .mapped import MappedIceFile
 
 
 @overload
 def unpack(
-    ice: IceFile, out_dir: Path, use_groups=False, dump_raw_data=False
+    ice: IceFile | MappedIceFile, out_dir: Path, use_groups=False, dump_raw_data=False
 ) -> Generator[Path, Any, None]:
     """
     Unpack an ICE archive
@@ -28,14 +30,15 @@ def unpack(
     """
     Unpack an ICE archive
 
-    :param ice: Path to ICE file to unpack
+    :param ice: Path to ICE file to unpack. Files are written as each group is
+        decoded, so PRS and uncompressed groups are never fully held in memory.
     :param out_dir: Output directory. Defaults to "<path>.extracted"
     :param use_groups: If True, write files to "group1" and "group2" subdirectories.
     """
 
 
 def unpack(
-    ice: IceFile | Path | str,
+    ice: IceFile | MappedIceFile | Path | str,
     out_dir: Optional[Path] = None,
     use_groups=False,
     dump_raw_data=False,
@@ -43,13 +46,25 @@ def unpack(
     """Unpack an ICE archive"""
     if isinstance(ice, (Path, str)):
         ice_path = ice
-        ice = IceFile.read(ice_path)
 
         if out_dir is None:
             out_dir = ice_path.with_suffix(".extracted")
-    else:
-        if out_dir is None:
-            raise ValueError("out_dir must be specified")
+
+        # Write each file as its group is decoded instead of building DataFiles
+        files, error, _ = native.unpack_many(
+            [(ice_path, out_dir)],
+            use_groups=use_groups,
+            dump_raw_data=dump_raw_data,
+            threads=1,
+        )[0]
+
+        if error is not None:
+            raise ValueError(error)
+
+        return [Path(f) for f in files]
+
+    if out_dir is None:
+        raise ValueError("out_dir must be specified")
 
     if use_groups:
         group1_dir = out_dir / "group1"